@@ -0,0 +1,99 @@
+/*********************
+**  Bounded queue
+**  A fixed-capacity, thread-safe FIFO of pointers used to connect pipeline stages.
+**********************/
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "BoundedQueue.h"
+
+struct BoundedQueue
+{
+	void** items;
+	int capacity;
+	int head;
+	int count;
+	int closed;
+	pthread_mutex_t lock;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
+};
+
+BoundedQueue* newBoundedQueue(int capacity)
+{
+	if (capacity < 1) {
+		return NULL;
+	}
+	BoundedQueue* queue = (BoundedQueue*) malloc(sizeof(BoundedQueue));
+	if (queue == NULL) {
+		return NULL;
+	}
+	queue->items = (void**) malloc(capacity * sizeof(void*));
+	if (queue->items == NULL) {
+		free(queue);
+		return NULL;
+	}
+	queue->capacity = capacity;
+	queue->head = 0;
+	queue->count = 0;
+	queue->closed = 0;
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->notEmpty, NULL);
+	pthread_cond_init(&queue->notFull, NULL);
+	return queue;
+}
+
+int BoundedQueuePush(BoundedQueue* queue, void* item)
+{
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == queue->capacity && !queue->closed) {
+		pthread_cond_wait(&queue->notFull, &queue->lock);
+	}
+	if (queue->closed) {
+		pthread_mutex_unlock(&queue->lock);
+		return 1;
+	}
+	queue->items[(queue->head + queue->count) % queue->capacity] = item;
+	queue->count += 1;
+	pthread_cond_signal(&queue->notEmpty);
+	pthread_mutex_unlock(&queue->lock);
+	return 0;
+}
+
+void* BoundedQueuePop(BoundedQueue* queue)
+{
+	void* item = NULL;
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == 0 && !queue->closed) {
+		pthread_cond_wait(&queue->notEmpty, &queue->lock);
+	}
+	if (queue->count > 0) {
+		item = queue->items[queue->head];
+		queue->head = (queue->head + 1) % queue->capacity;
+		queue->count -= 1;
+		pthread_cond_signal(&queue->notFull);
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return item;
+}
+
+void BoundedQueueClose(BoundedQueue* queue)
+{
+	pthread_mutex_lock(&queue->lock);
+	queue->closed = 1;
+	pthread_cond_broadcast(&queue->notEmpty);
+	pthread_cond_broadcast(&queue->notFull);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+void freeBoundedQueue(BoundedQueue* queue)
+{
+	if (queue == NULL) {
+		return;
+	}
+	pthread_mutex_destroy(&queue->lock);
+	pthread_cond_destroy(&queue->notEmpty);
+	pthread_cond_destroy(&queue->notFull);
+	free(queue->items);
+	free(queue);
+}
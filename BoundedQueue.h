@@ -0,0 +1,27 @@
+/*********************
+**  Bounded queue
+**  A fixed-capacity, thread-safe FIFO of pointers used to connect pipeline stages.
+**  Producers block while it is full, so a fast stage can never run more than capacity items ahead.
+**********************/
+
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+typedef struct BoundedQueue BoundedQueue;
+
+//Returns a new empty queue holding at most capacity items, or NULL on failure
+BoundedQueue* newBoundedQueue(int capacity);
+
+//Appends item, waiting while the queue is full. Returns 0 on success, or 1 if the queue has been closed.
+int BoundedQueuePush(BoundedQueue* queue, void* item);
+
+//Removes and returns the oldest item, waiting while the queue is empty. Returns NULL once the queue is closed and drained.
+void* BoundedQueuePop(BoundedQueue* queue);
+
+//Marks the end of the stream: no more pushes are accepted, and waiting consumers wake up once the queue drains
+void BoundedQueueClose(BoundedQueue* queue);
+
+//Frees the queue. Items still inside are not freed.
+void freeBoundedQueue(BoundedQueue* queue);
+
+#endif
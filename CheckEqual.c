@@ -0,0 +1,174 @@
+/*********************
+**  checkequal
+**  A native replacement for the checkequal half of verify.py: compares two iteration maps pixel by pixel
+**  and prints the same report. Either file may be a .txt map or a binary iteration map file (see IterationFile.h);
+**  binary files are mmapped and compared in place, without parsing.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "IterationMap.h"
+#include "IterationFile.h"
+
+//The counts of one file, whichever format it came in
+typedef struct Counts
+{
+	const void* data;
+	int elementSize;
+	u_int64_t length;
+	IterationFile* file;   //Set for binary files
+	u_int64_t* parsed;     //Set for text files
+} Counts;
+
+//Parses whitespace-separated decimal counts from text. Returns the number of counts, or -1 on a stray character.
+static int64_t parseCounts(const char* text, size_t length, u_int64_t* output)
+{
+	int64_t count = 0;
+	size_t i = 0;
+	while (i < length) {
+		char c = text[i];
+		if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+			i++;
+			continue;
+		}
+		if (c < '0' || c > '9') {
+			return -1;
+		}
+		u_int64_t value = 0;
+		while (i < length && text[i] >= '0' && text[i] <= '9') {
+			value = value * 10 + (u_int64_t) (text[i] - '0');
+			i++;
+		}
+		if (output != NULL) {
+			output[count] = value;
+		}
+		count++;
+	}
+	return count;
+}
+
+//Loads filename into counts. Returns 0 on success, and prints the problem and returns 1 otherwise.
+static int loadCounts(const char* filename, Counts* counts)
+{
+	memset(counts, 0, sizeof(Counts));
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		printf("Unable to open %s\n", filename);
+		return 1;
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0) {
+		printf("Unable to read %s\n", filename);
+		close(fd);
+		return 1;
+	}
+	size_t length = (size_t) status.st_size;
+	if (length == 0) {
+		close(fd);
+		counts->elementSize = 8;
+		return 0;
+	}
+	char* text = (char*) mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (text == MAP_FAILED) {
+		printf("Unable to map %s\n", filename);
+		return 1;
+	}
+	if (IsIterationFile(text, length)) {
+		munmap(text, length);
+		counts->file = openIterationFile(filename);
+		if (counts->file == NULL) {
+			return 1;
+		}
+		counts->data = counts->file->map.data;
+		counts->elementSize = counts->file->map.elementSize;
+		counts->length = counts->file->map.size * counts->file->map.size;
+		return 0;
+	}
+	/* text is parsed twice: once to count, once to store, so no guess about its size is needed */
+	int64_t count = parseCounts(text, length, NULL);
+	if (count < 0) {
+		printf("%s is neither an iteration map file nor a text map\n", filename);
+		munmap(text, length);
+		return 1;
+	}
+	counts->parsed = (u_int64_t*) malloc((count > 0 ? count : 1) * sizeof(u_int64_t));
+	if (counts->parsed == NULL) {
+		printf("Unable to allocate %ld bytes\n", (long) (count * sizeof(u_int64_t)));
+		munmap(text, length);
+		return 1;
+	}
+	parseCounts(text, length, counts->parsed);
+	munmap(text, length);
+	counts->data = counts->parsed;
+	counts->elementSize = 8;
+	counts->length = (u_int64_t) count;
+	return 0;
+}
+
+static void freeCounts(Counts* counts)
+{
+	closeIterationFile(counts->file);
+	free(counts->parsed);
+}
+
+//Prints value the way Python's str() prints a float: the shortest digits that read back as the same double
+static void printPythonFloat(double value)
+{
+	char digits[40];
+	int precision = 1;
+	for (; precision < 17; precision++) {
+		snprintf(digits, sizeof(digits), "%.*e", precision - 1, value);
+		if (strtod(digits, NULL) == value) {
+			break;
+		}
+	}
+	snprintf(digits, sizeof(digits), "%.*e", precision - 1, value);
+	int exponent = atoi(strchr(digits, 'e') + 1);
+	/* like Python, fixed notation for exponents from -4 to 15 and scientific notation outside them */
+	if (exponent < -4 || exponent >= 16) {
+		snprintf(digits, sizeof(digits), "%.*g", precision, value);
+		printf("%s", digits);
+		return;
+	}
+	int decimals = precision - 1 - exponent;
+	printf("%.*f", decimals > 1 ? decimals : 1, value);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc != 3) {
+		printf("Incorrect number of arguments, use %s <File 1> <File 2>\n", argv[0]);
+		return 1;
+	}
+	Counts reference, student;
+	if (loadCounts(argv[1], &reference)) {
+		return 1;
+	}
+	if (loadCounts(argv[2], &student)) {
+		freeCounts(&reference);
+		return 1;
+	}
+	if (student.length != reference.length) {
+		printf("Total number of pixels is incorrect! Your output has %lu pixels, but reference has %lu pixels\n", student.length, reference.length);
+		freeCounts(&reference);
+		freeCounts(&student);
+		return 1;
+	}
+	u_int64_t inaccurate = 0;
+	for (u_int64_t i = 0; i < student.length; i++) {
+		inaccurate += IterationLoad(student.data, student.elementSize, i) != IterationLoad(reference.data, reference.elementSize, i);
+	}
+	printf("You have %lu inaccurate pixels, which is a ", inaccurate);
+	printPythonFloat((1 - ((double) inaccurate / student.length)) * 100);
+	printf("\\%% accuracy.\n");
+	freeCounts(&reference);
+	freeCounts(&student);
+	return 0;
+}
@@ -12,4 +12,5 @@
 ***************/
 uint8_t** FileToColorMap(char* colorfile, int* colorcount);
 
-
+//Frees a color array returned by FileToColorMap, given the colorcount it was read with
+void freeDoublePointer(uint8_t** input, int* colorcount);
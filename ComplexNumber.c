@@ -59,6 +59,28 @@ void freeComplexNumber(ComplexNumber* a)
 	free(a);
 }
 
+double ComplexAbsSquaredThreshold(double threshold)
+{
+	if (isnan(threshold)) {
+		return threshold;
+	}
+	if (threshold <= 0) {
+		return 0;
+	}
+	double squared = threshold * threshold;
+	if (isinf(squared)) {
+		return squared;
+	}
+	/* threshold*threshold is rounded, so walk it to the exact boundary of sqrt(x) >= threshold. */
+	while (sqrt(squared) < threshold) {
+		squared = nextafter(squared, INFINITY);
+	}
+	while (sqrt(nextafter(squared, 0)) >= threshold) {
+		squared = nextafter(squared, 0);
+	}
+	return squared;
+}
+
 double Re(ComplexNumber* a)
 {
 	return a->real;
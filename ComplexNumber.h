@@ -4,7 +4,8 @@
 **  It is advised that you work on this part first.
 **********************/
 
-
+#ifndef COMPLEXNUMBER_H
+#define COMPLEXNUMBER_H
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,3 +32,57 @@ extern int test_complex_number();
 extern double Re(ComplexNumber* a);
 //Gets the imaginary component of the complex number
 extern double Im(ComplexNumber* a);
+
+
+/*
+By-value complex numbers. These never touch the heap and are meant for inner loops.
+Each operation rounds exactly like its pointer counterpart above, so the two APIs give identical results.
+*/
+typedef struct ComplexValue
+{
+	double real;
+	double imaginary;
+} ComplexValue;
+
+//Returns a Complex Value with the given real and imaginary components
+static inline ComplexValue ComplexValueOf(double real_component, double imaginary_component)
+{
+	ComplexValue result = {real_component, imaginary_component};
+	return result;
+}
+
+//Returns a*b, computed the same way as ComplexProduct
+static inline ComplexValue ComplexValueProduct(ComplexValue a, ComplexValue b)
+{
+	ComplexValue result;
+	result.real = (a.real * b.real) + (-1 * a.imaginary * b.imaginary);
+	result.imaginary = (a.real * b.imaginary) + (b.real * a.imaginary);
+	return result;
+}
+
+//Returns a+b
+static inline ComplexValue ComplexValueSum(ComplexValue a, ComplexValue b)
+{
+	return ComplexValueOf(a.real + b.real, a.imaginary + b.imaginary);
+}
+
+//Returns the square of the absolute value of a, i.e. ComplexAbs without the sqrt
+static inline double ComplexValueAbsSquared(ComplexValue a)
+{
+	return (a.real * a.real) + (a.imaginary * a.imaginary);
+}
+
+//Copies the Complex Number a into a Complex Value
+static inline ComplexValue ComplexToValue(ComplexNumber* a)
+{
+	return ComplexValueOf(Re(a), Im(a));
+}
+
+/*
+Returns the smallest squared magnitude whose square root is >= threshold.
+ComplexValueAbsSquared(a) >= ComplexAbsSquaredThreshold(t) holds exactly when ComplexAbs(a) >= t,
+so a loop can skip the sqrt without changing a single result.
+*/
+extern double ComplexAbsSquaredThreshold(double threshold);
+
+#endif
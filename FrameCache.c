@@ -0,0 +1,276 @@
+/*********************
+**  Frame cache
+**  Names are 64-bit FNV-1a hashes in hex. Map names also spell out the method flags, and map files carry their view
+**  in their header, which is compared field by field, so a hash collision cannot hand out the wrong map. Frames are
+**  only checked for a P6 header of the right size and the right file length, so a collision between two views, or a
+**  frame overwritten with other pixels of the same size, would go unnoticed.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "FrameCache.h"
+#include "PPMWriter.h"
+#include "Hash.h"
+
+struct FrameCache
+{
+	char* directory;
+	u_int64_t method;  //Render settings that change counts, as flags
+	u_int64_t palette; //Hash of the palette's colors
+	int precision;     //MANDELBROT_PRECISION_* of the settings, which decides per view whether it is rendered in float
+	pthread_mutex_t lock;
+	FrameCacheStats stats;
+};
+
+//Everything a view hash covers. Every field is 8 bytes wide, so there is no padding to hash.
+typedef struct FrameCacheKey
+{
+	double threshold;
+	u_int64_t max_iterations;
+	double centerReal;
+	double centerImaginary;
+	double scale;
+	u_int64_t resolution;
+	u_int64_t method;
+} FrameCacheKey;
+
+#define FRAME_CACHE_SUBDIVIDE 1
+#define FRAME_CACHE_PERTURBATION 2
+#define FRAME_CACHE_SERIES 4
+#define FRAME_CACHE_FLOAT 8
+
+//Bytes copied at a time from the cache to the output folder
+#define FRAME_CACHE_COPY_CHUNK (1 << 20)
+
+FrameCache* newFrameCache(const char* directory, const MandelbrotSettings* settings, const Palette* palette)
+{
+	if (mkdir(directory, 0777) != 0 && errno != EEXIST) {
+		return NULL;
+	}
+	FrameCache* cache = (FrameCache*) calloc(1, sizeof(FrameCache));
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache->directory = strdup(directory);
+	if (cache->directory == NULL) {
+		free(cache);
+		return NULL;
+	}
+	cache->method = (settings->subdivide ? FRAME_CACHE_SUBDIVIDE : 0)
+		| (settings->perturbation != NULL ? FRAME_CACHE_PERTURBATION : 0)
+		| (settings->perturbation != NULL && settings->series ? FRAME_CACHE_SERIES : 0);
+	cache->precision = settings->perturbation != NULL ? MANDELBROT_PRECISION_DOUBLE : settings->precision;
+	u_int64_t colorcount = (u_int64_t) palette->colorcount;
+	cache->palette = HashBytes(HASH_SEED, &colorcount, sizeof(colorcount));
+	cache->palette = HashBytes(cache->palette, palette->colors, 3 * colorcount);
+	pthread_mutex_init(&cache->lock, NULL);
+	return cache;
+}
+
+//Fills key for view. Returns the hash of the key.
+static u_int64_t viewKey(const FrameCache* cache, const MandelView* view, FrameCacheKey* key)
+{
+	key->threshold = view->threshold;
+	key->max_iterations = view->max_iterations;
+	key->centerReal = view->centerReal;
+	key->centerImaginary = view->centerImaginary;
+	key->scale = view->scale;
+	key->resolution = view->resolution;
+	key->method = cache->method;
+	if (MandelbrotUsesFloat(cache->precision, view->centerReal, view->centerImaginary, view->scale, view->resolution, view->max_iterations)) {
+		key->method |= FRAME_CACHE_FLOAT;
+	}
+	return HashBytes(HASH_SEED, key, sizeof(FrameCacheKey));
+}
+
+//Room for what the names below add to the directory: "/frame-", two 16-digit hashes, "-", ".ppm" and the terminator
+#define FRAME_CACHE_NAME_LENGTH 64
+
+/*
+The header of a map file holds the view but not the method, so the method goes into the name as it is.
+Returns the name, which the caller frees, or NULL if it could not be allocated.
+*/
+static char* mapName(const FrameCache* cache, const MandelView* view)
+{
+	char* name = (char*) malloc(strlen(cache->directory) + FRAME_CACHE_NAME_LENGTH);
+	if (name != NULL) {
+		FrameCacheKey key;
+		u_int64_t hash = viewKey(cache, view, &key);
+		sprintf(name, "%s/map-%016lx-%lx.mbi", cache->directory, hash, key.method);
+	}
+	return name;
+}
+
+//Returns the name of the frame of view, which the caller frees, or NULL if it could not be allocated
+static char* frameName(const FrameCache* cache, const MandelView* view)
+{
+	char* name = (char*) malloc(strlen(cache->directory) + FRAME_CACHE_NAME_LENGTH);
+	if (name != NULL) {
+		FrameCacheKey key;
+		sprintf(name, "%s/frame-%016lx-%016lx.ppm", cache->directory, viewKey(cache, view, &key), cache->palette);
+	}
+	return name;
+}
+
+/*
+Creates an empty file with a unique temporary name in the cache directory. Returns its descriptor, and its name in
+*name for the caller to free, or -1 with *name NULL.
+*/
+static int openTemporary(const FrameCache* cache, char** name)
+{
+	*name = (char*) malloc(strlen(cache->directory) + FRAME_CACHE_NAME_LENGTH);
+	if (*name == NULL) {
+		return -1;
+	}
+	sprintf(*name, "%s/.tmp-XXXXXX", cache->directory);
+	int fd = mkstemp(*name);
+	if (fd < 0) {
+		free(*name);
+		*name = NULL;
+		return -1;
+	}
+	/* mkstemp makes files only their owner can read, which would keep other users of a shared cache out */
+	fchmod(fd, 0644);
+	return fd;
+}
+
+static void count(FrameCache* cache, u_int64_t* counter)
+{
+	pthread_mutex_lock(&cache->lock);
+	*counter += 1;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+int FrameCacheLoadFrame(FrameCache* cache, const MandelView* view, const char* filename)
+{
+	char* name = frameName(cache, view);
+	if (name == NULL) {
+		return 1;
+	}
+	u_int64_t size = 2 * view->resolution + 1;
+	char header[64];
+	int headerLength = snprintf(header, sizeof(header), "P6 %lu %lu 255\n", size, size);
+	u_int64_t expected = headerLength + 3 * size * size;
+	int input = open(name, O_RDONLY);
+	free(name);
+	if (input < 0) {
+		return 1;
+	}
+	struct stat status;
+	char* buffer = (char*) malloc(FRAME_CACHE_COPY_CHUNK);
+	if (buffer == NULL || fstat(input, &status) != 0 || (u_int64_t) status.st_size != expected
+		|| read(input, buffer, headerLength) != headerLength || memcmp(buffer, header, headerLength) != 0) {
+		free(buffer);
+		close(input);
+		return 1;
+	}
+	int output = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	int failed = output < 0 || write(output, buffer, headerLength) != headerLength;
+	u_int64_t copied = headerLength;
+	while (!failed && copied < expected) {
+		ssize_t length = read(input, buffer, FRAME_CACHE_COPY_CHUNK);
+		failed = length <= 0 || write(output, buffer, length) != length;
+		copied += failed ? 0 : length;
+	}
+	if (output >= 0 && close(output) != 0) {
+		failed = 1;
+	}
+	close(input);
+	free(buffer);
+	if (!failed) {
+		count(cache, &cache->stats.frames);
+	}
+	return failed;
+}
+
+int FrameCacheStoreFrame(FrameCache* cache, const MandelView* view, const uint8_t* pixels)
+{
+	char* temporary;
+	int fd = openTemporary(cache, &temporary);
+	if (fd < 0) {
+		return 1;
+	}
+	close(fd);
+	u_int64_t size = 2 * view->resolution + 1;
+	char* name = frameName(cache, view);
+	int failed = name == NULL || WritePPM(temporary, PPM_P6, size, size, pixels) || rename(temporary, name) != 0;
+	if (failed) {
+		unlink(temporary);
+	}
+	free(name);
+	free(temporary);
+	return failed;
+}
+
+IterationFile* FrameCacheOpenMap(FrameCache* cache, const MandelView* view)
+{
+	char* name = mapName(cache, view);
+	IterationFile* file = name != NULL && access(name, R_OK) == 0 ? openIterationFile(name) : NULL;
+	free(name);
+	if (file == NULL) {
+		return NULL;
+	}
+	const IterationFileHeader* header = file->header;
+	if (header->resolution != view->resolution || header->max_iterations != view->max_iterations
+		|| header->centerReal != view->centerReal || header->centerImaginary != view->centerImaginary
+		|| header->scale != view->scale || header->threshold != view->threshold
+		|| file->map.elementSize != IterationMapElementSize(view->max_iterations)) {
+		closeIterationFile(file);
+		return NULL;
+	}
+	count(cache, &cache->stats.maps);
+	return file;
+}
+
+int FrameCacheStoreMap(FrameCache* cache, const MandelView* view, const IterationMap* map)
+{
+	char* temporary;
+	int fd = openTemporary(cache, &temporary);
+	FILE* file = fd >= 0 ? fdopen(fd, "w") : NULL;
+	if (file == NULL) {
+		if (fd >= 0) {
+			close(fd);
+			unlink(temporary);
+		}
+		free(temporary);
+		return 1;
+	}
+	IterationFileHeader header;
+	IterationFileHeaderInit(&header, map, view->resolution, view->max_iterations, view->centerReal, view->centerImaginary, view->scale, view->threshold);
+	int failed = WriteIterationFile(file, &header, map);
+	failed = fclose(file) != 0 || failed;
+	char* name = mapName(cache, view);
+	failed = failed || name == NULL || rename(temporary, name) != 0;
+	if (failed) {
+		unlink(temporary);
+	}
+	free(name);
+	free(temporary);
+	if (!failed) {
+		count(cache, &cache->stats.stored);
+	}
+	return failed;
+}
+
+void FrameCacheGetStats(FrameCache* cache, FrameCacheStats* stats)
+{
+	pthread_mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void freeFrameCache(FrameCache* cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->directory);
+	free(cache);
+}
@@ -0,0 +1,61 @@
+/*********************
+**  Frame cache
+**  A directory of finished frames and the iteration maps they were colored from, named by a hash of everything
+**  that decides their contents, so a movie that was interrupted, or is rerun with another palette, only renders
+**  what it has not rendered before:
+**      map-<view>-<method>.mbi    the binary iteration map file (see IterationFile.h) of a view
+**      frame-<view>-<palette>.ppm that map colored with a palette
+**  <view> hashes the threshold, max_iterations, center, scale and resolution of the frame, and the render settings
+**  that change iteration counts (subdivision, perturbation, series approximation, float), which <method> also gives
+**  as flags; <palette> hashes the colors.
+**  Files are written under a temporary name and renamed into place, so a file that is present is complete.
+**  Maps are checked against their view and element width before they are used; frames only against their size.
+**********************/
+
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "Mandelbrot.h"
+#include "MandelContext.h"
+#include "IterationFile.h"
+#include "Palette.h"
+
+typedef struct FrameCache FrameCache;
+
+/*
+Returns a cache in directory, which is created if needed, for frames rendered with settings and colored with palette.
+Returns NULL on failure.
+*/
+FrameCache* newFrameCache(const char* directory, const MandelbrotSettings* settings, const Palette* palette);
+
+/*
+Copies the cached frame of view to filename. Returns 0 on success, and 1 if it is not cached or its P6 header or
+file length is not that of a frame of view; the pixels themselves are not checked.
+*/
+int FrameCacheLoadFrame(FrameCache* cache, const MandelView* view, const char* filename);
+
+//Stores pixels, the P6 pixels of the frame of view. Returns 0 on success and 1 on failure.
+int FrameCacheStoreFrame(FrameCache* cache, const MandelView* view, const uint8_t* pixels);
+
+//Returns the cached iteration map of view, mapped into memory, or NULL if it is not cached or its header does not match view
+IterationFile* FrameCacheOpenMap(FrameCache* cache, const MandelView* view);
+
+//Stores map, the iteration map of view. Returns 0 on success and 1 on failure.
+int FrameCacheStoreMap(FrameCache* cache, const MandelView* view, const IterationMap* map);
+
+//What the cache did since it was made
+typedef struct FrameCacheStats
+{
+	u_int64_t frames;  //Frames copied from the cache
+	u_int64_t maps;    //Frames colored from a cached iteration map
+	u_int64_t stored;  //Iteration maps rendered and stored
+} FrameCacheStats;
+
+void FrameCacheGetStats(FrameCache* cache, FrameCacheStats* stats);
+
+//Frees the cache; the directory stays
+void freeFrameCache(FrameCache* cache);
+
+#endif
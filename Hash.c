@@ -0,0 +1,16 @@
+/*********************
+**  Hashing
+**********************/
+
+#include <stdint.h>
+#include "Hash.h"
+
+u_int64_t HashBytes(u_int64_t seed, const void* data, u_int64_t length)
+{
+	const uint8_t* bytes = (const uint8_t*) data;
+	u_int64_t hash = seed;
+	for (u_int64_t i = 0; i < length; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
@@ -0,0 +1,21 @@
+/*********************
+**  Hashing
+**  64-bit FNV-1a, the hash behind the tile cache's table, the checksums of band files and the names in the frame cache.
+**  It is not cryptographic: it spreads keys and catches damaged files, nothing more.
+**********************/
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <sys/types.h>
+
+//The FNV-1a offset basis, which every hash starts from
+#define HASH_SEED 14695981039346656037ULL
+
+/*
+Returns the FNV-1a hash of length bytes of data, continuing from seed: HASH_SEED for a new hash, or the result of
+an earlier call to hash several pieces as if they were one.
+*/
+u_int64_t HashBytes(u_int64_t seed, const void* data, u_int64_t length);
+
+#endif
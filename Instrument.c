@@ -0,0 +1,163 @@
+/*********************
+**  Instrumentation
+**  Lines from every thread go through one lock, so they never interleave. Tiles are a few thousand
+**  pixels at least, so taking the lock once per tile costs nothing next to the rendering.
+**********************/
+
+#include "Instrument.h"
+
+#ifdef MANDEL_INSTRUMENT
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "IterationMap.h"
+
+static FILE* output = NULL;
+static int failed = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread InstrumentFrame* currentFrame = NULL;
+
+static const char* stageNames[INSTRUMENT_STAGES] = {"render", "colorize", "write"};
+
+int InstrumentOpen(const char* filename)
+{
+	output = fopen(filename, "w");
+	failed = 0;
+	return output == NULL;
+}
+
+int InstrumentClose(void)
+{
+	if (output == NULL) {
+		return 0;
+	}
+	int result = fclose(output) != 0 || failed;
+	output = NULL;
+	return result;
+}
+
+static u_int64_t nanoseconds(clockid_t clock)
+{
+	struct timespec time;
+	clock_gettime(clock, &time);
+	return (u_int64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+InstrumentTime InstrumentNow(void)
+{
+	InstrumentTime now = {nanoseconds(CLOCK_MONOTONIC), nanoseconds(CLOCK_THREAD_CPUTIME_ID)};
+	return now;
+}
+
+void InstrumentFrameBegin(InstrumentFrame* frame, int number, double scale, u_int64_t max_iterations)
+{
+	memset(frame, 0, sizeof(InstrumentFrame));
+	frame->number = number;
+	frame->scale = scale;
+	frame->max_iterations = max_iterations;
+	currentFrame = output != NULL ? frame : NULL;
+}
+
+InstrumentFrame* InstrumentCurrentFrame(void)
+{
+	return output != NULL ? currentFrame : NULL;
+}
+
+void InstrumentStageEnd(InstrumentFrame* frame, int stage, InstrumentTime start)
+{
+	if (frame == NULL || output == NULL) {
+		return;
+	}
+	InstrumentTime now = InstrumentNow();
+	pthread_mutex_lock(&lock);
+	frame->stages[stage].wall += now.wall - start.wall;
+	frame->stages[stage].cpu += stage == INSTRUMENT_RENDER ? frame->tileCpu : now.cpu - start.cpu;
+	frame->tileCpu = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+void InstrumentCountsAdd(InstrumentCounts* counts, const void* data, int elementSize, u_int64_t count, u_int64_t max_iterations)
+{
+	counts->pixels += count;
+	for (u_int64_t i = 0; i < count; i++) {
+		u_int64_t iterations = IterationLoad(data, elementSize, i);
+		if (iterations == 0) {
+			counts->maxed += 1;
+			counts->iterations += max_iterations;
+			continue;
+		}
+		counts->escaped += 1;
+		counts->iterations += iterations;
+		counts->histogram[63 - __builtin_clzll(iterations)] += 1;
+	}
+}
+
+static void addCounts(InstrumentCounts* total, const InstrumentCounts* counts)
+{
+	total->pixels += counts->pixels;
+	total->iterations += counts->iterations;
+	total->escaped += counts->escaped;
+	total->maxed += counts->maxed;
+	for (int b = 0; b < INSTRUMENT_HISTOGRAM_BUCKETS; b++) {
+		total->histogram[b] += counts->histogram[b];
+	}
+}
+
+//Writes one line, which must already end in a newline. Called with the lock held.
+static void writeLine(const char* line, int length)
+{
+	if (output == NULL) {
+		return;
+	}
+	if (fwrite(line, 1, length, output) != (size_t) length) {
+		failed = 1;
+	}
+}
+
+void InstrumentTileEnd(InstrumentFrame* frame, u_int64_t tile, u_int64_t row, u_int64_t column, u_int64_t width, u_int64_t height, const InstrumentCounts* counts, InstrumentTime start)
+{
+	InstrumentTime now = InstrumentNow();
+	char line[512];
+	int length = snprintf(line, sizeof(line),
+		"{\"event\": \"tile\", \"frame\": %d, \"scale\": %.17g, \"tile\": %lu, \"row\": %lu, \"column\": %lu, \"width\": %lu, \"height\": %lu, "
+		"\"pixels\": %lu, \"iterations\": %lu, \"escaped\": %lu, \"maxed\": %lu, \"wall_ns\": %lu, \"cpu_ns\": %lu}\n",
+		frame->number, frame->scale, tile, row, column, width, height,
+		counts->pixels, counts->iterations, counts->escaped, counts->maxed, now.wall - start.wall, now.cpu - start.cpu);
+	pthread_mutex_lock(&lock);
+	addCounts(&frame->counts, counts);
+	frame->tiles += 1;
+	frame->tileCpu += now.cpu - start.cpu;
+	writeLine(line, length);
+	pthread_mutex_unlock(&lock);
+}
+
+void InstrumentFrameEnd(InstrumentFrame* frame)
+{
+	if (frame == NULL || output == NULL) {
+		return;
+	}
+	char line[4096];
+	int length = snprintf(line, sizeof(line),
+		"{\"event\": \"frame\", \"frame\": %d, \"scale\": %.17g, \"max_iterations\": %lu, \"tiles\": %lu, "
+		"\"pixels\": %lu, \"iterations\": %lu, \"escaped\": %lu, \"maxed\": %lu",
+		frame->number, frame->scale, frame->max_iterations, frame->tiles,
+		frame->counts.pixels, frame->counts.iterations, frame->counts.escaped, frame->counts.maxed);
+	for (int stage = 0; stage < INSTRUMENT_STAGES; stage++) {
+		length += snprintf(line + length, sizeof(line) - length, ", \"%s\": {\"wall_ns\": %lu, \"cpu_ns\": %lu}",
+			stageNames[stage], frame->stages[stage].wall, frame->stages[stage].cpu);
+	}
+	/* the histogram stops at the bucket of max_iterations, past which it is always empty */
+	int buckets = frame->max_iterations > 0 ? 64 - __builtin_clzll(frame->max_iterations) : 1;
+	length += snprintf(line + length, sizeof(line) - length, ", \"histogram\": [");
+	for (int b = 0; b < buckets; b++) {
+		length += snprintf(line + length, sizeof(line) - length, b > 0 ? ", %lu" : "%lu", frame->counts.histogram[b]);
+	}
+	length += snprintf(line + length, sizeof(line) - length, "]}\n");
+	pthread_mutex_lock(&lock);
+	writeLine(line, length);
+	pthread_mutex_unlock(&lock);
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*********************
+**  Instrumentation
+**  Optional timing and iteration statistics, written as one JSON object per line.
+**  Only built in with -DMANDEL_INSTRUMENT (make INSTRUMENT=1); otherwise every INSTRUMENT(...) hook compiles to nothing.
+**
+**  Two kinds of lines are written:
+**  {"event": "tile", ...}   one per rendered tile: its position, pixel and iteration counts, wall and CPU time
+**  {"event": "frame", ...}  one per frame: its scale, counts, an iteration histogram, and wall and CPU time of every stage
+**********************/
+
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <sys/types.h>
+
+#ifdef MANDEL_INSTRUMENT
+#define INSTRUMENT(statement) statement
+#else
+#define INSTRUMENT(statement)
+#endif
+
+//Stages of a frame
+#define INSTRUMENT_RENDER 0
+#define INSTRUMENT_COLORIZE 1
+#define INSTRUMENT_WRITE 2
+#define INSTRUMENT_STAGES 3
+
+//Histogram bucket b holds the escaped pixels with counts in [2^b, 2^(b+1))
+#define INSTRUMENT_HISTOGRAM_BUCKETS 64
+
+/*
+Counts of the pixels a render actually computed. Pixels filled in by subdivision are not included. Rows copied across
+the real axis (see gridRender) are, and are counted in the tile that rendered the row they were copied from, so
+the tiles of a frame add up to all of its pixels but a single tile can count more pixels than it covers.
+iterations counts max_iterations for every pixel that never escaped, so it is an upper bound when interior shortcuts are on.
+*/
+typedef struct InstrumentCounts
+{
+	u_int64_t pixels;
+	u_int64_t iterations;
+	u_int64_t escaped;
+	u_int64_t maxed;
+	u_int64_t histogram[INSTRUMENT_HISTOGRAM_BUCKETS];
+} InstrumentCounts;
+
+//A point in time, or a duration, in nanoseconds: wall clock, and CPU time of the calling thread
+typedef struct InstrumentTime
+{
+	u_int64_t wall;
+	u_int64_t cpu;
+} InstrumentTime;
+
+typedef struct InstrumentFrame
+{
+	int number;
+	double scale;
+	u_int64_t max_iterations;
+	u_int64_t tiles;
+	InstrumentCounts counts;
+	InstrumentTime stages[INSTRUMENT_STAGES];
+	u_int64_t tileCpu;  //CPU time of all tiles, on whatever threads they ran
+} InstrumentFrame;
+
+//Starts writing to filename. Returns 0 on success and 1 on failure. Until this is called, nothing is recorded.
+int InstrumentOpen(const char* filename);
+
+//Stops recording and closes the file. Returns 0 if every line was written and 1 otherwise.
+int InstrumentClose(void);
+
+InstrumentTime InstrumentNow(void);
+
+/*
+Resets frame for frame number number and makes it the calling thread's current frame:
+renders started on this thread from now on add their tiles to it (see InstrumentCurrentFrame).
+*/
+void InstrumentFrameBegin(InstrumentFrame* frame, int number, double scale, u_int64_t max_iterations);
+
+//The calling thread's current frame, or NULL when nothing is being recorded
+InstrumentFrame* InstrumentCurrentFrame(void);
+
+/*
+Adds the time since start to the given stage of frame. On the render stage, CPU time is taken from the tiles instead.
+This and InstrumentFrameEnd do nothing for a NULL frame.
+*/
+void InstrumentStageEnd(InstrumentFrame* frame, int stage, InstrumentTime start);
+
+//Adds count elementSize-byte iteration counts from data to counts
+void InstrumentCountsAdd(InstrumentCounts* counts, const void* data, int elementSize, u_int64_t count, u_int64_t max_iterations);
+
+//Writes the line of a finished tile and adds its counts and the time since start to frame
+void InstrumentTileEnd(InstrumentFrame* frame, u_int64_t tile, u_int64_t row, u_int64_t column, u_int64_t width, u_int64_t height, const InstrumentCounts* counts, InstrumentTime start);
+
+//Writes the line of a finished frame
+void InstrumentFrameEnd(InstrumentFrame* frame);
+
+#endif
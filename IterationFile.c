@@ -0,0 +1,101 @@
+/*********************
+**  Binary iteration map files
+**  Writing is one fwrite of the header and one of the counts; reading is one mmap.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "IterationMap.h"
+#include "IterationFile.h"
+
+_Static_assert(sizeof(IterationFileHeader) == 64, "the counts must start at byte 64");
+
+void IterationFileHeaderInit(IterationFileHeader* header, const IterationMap* map, u_int64_t resolution, u_int64_t max_iterations, double centerReal, double centerImaginary, double scale, double threshold)
+{
+	memset(header, 0, sizeof(IterationFileHeader));
+	memcpy(header->magic, ITERATION_FILE_MAGIC, sizeof(header->magic));
+	header->version = ITERATION_FILE_VERSION;
+	header->elementSize = (uint32_t) map->elementSize;
+	header->resolution = resolution;
+	header->max_iterations = max_iterations;
+	header->centerReal = centerReal;
+	header->centerImaginary = centerImaginary;
+	header->scale = scale;
+	header->threshold = threshold;
+}
+
+int WriteIterationFile(FILE* outputfile, const IterationFileHeader* header, const IterationMap* map)
+{
+	size_t counts = map->size * map->size;
+	if (fwrite(header, sizeof(IterationFileHeader), 1, outputfile) != 1) {
+		return 1;
+	}
+	return fwrite(map->data, map->elementSize, counts, outputfile) != counts;
+}
+
+int IsIterationFile(const void* start, size_t length)
+{
+	return length >= sizeof(IterationFileHeader) && memcmp(start, ITERATION_FILE_MAGIC, 8) == 0;
+}
+
+IterationFile* openIterationFile(const char* filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		printf("Unable to open %s\n", filename);
+		return NULL;
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0 || (size_t) status.st_size < sizeof(IterationFileHeader)) {
+		printf("%s is too short to be an iteration map file\n", filename);
+		close(fd);
+		return NULL;
+	}
+	size_t length = (size_t) status.st_size;
+	void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		printf("Unable to map %s\n", filename);
+		return NULL;
+	}
+	const IterationFileHeader* header = (const IterationFileHeader*) mapping;
+	u_int64_t size = 2 * header->resolution + 1;
+	if (!IsIterationFile(mapping, length) || header->version != ITERATION_FILE_VERSION) {
+		printf("%s is not a version %d iteration map file\n", filename, ITERATION_FILE_VERSION);
+		munmap(mapping, length);
+		return NULL;
+	}
+	if ((header->elementSize != 2 && header->elementSize != 4 && header->elementSize != 8)
+		|| header->resolution > (1ull << 28)
+		|| length - sizeof(IterationFileHeader) < size * size * header->elementSize) {
+		printf("%s has a damaged header or is truncated\n", filename);
+		munmap(mapping, length);
+		return NULL;
+	}
+	IterationFile* file = (IterationFile*) malloc(sizeof(IterationFile));
+	if (file == NULL) {
+		munmap(mapping, length);
+		return NULL;
+	}
+	file->header = header;
+	file->map.size = size;
+	file->map.elementSize = (int) header->elementSize;
+	file->map.data = (char*) mapping + sizeof(IterationFileHeader);
+	file->mapping = mapping;
+	file->length = length;
+	return file;
+}
+
+void closeIterationFile(IterationFile* file)
+{
+	if (file == NULL) {
+		return;
+	}
+	munmap(file->mapping, file->length);
+	free(file);
+}
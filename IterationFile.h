@@ -0,0 +1,70 @@
+/*********************
+**  Binary iteration map files
+**  A 64-byte header followed by the raw counts, row by row from the top left corner, in the host's byte order
+**  (little-endian on x86). The counts start on a 64-byte boundary and have the header's element width,
+**  so a reader can mmap the file and index the counts directly, without parsing anything.
+**
+**  Offset  Size  Field
+**       0     8  magic "MANDITER"
+**       8     4  version (1)
+**      12     4  elementSize: 2, 4 or 8 bytes per count
+**      16     8  resolution; the map has (2 * resolution + 1)^2 counts
+**      24     8  max_iterations
+**      32     8  center real part (double)
+**      40     8  center imaginary part (double)
+**      48     8  scale (double)
+**      56     8  threshold (double)
+**      64        counts
+**********************/
+
+#ifndef ITERATIONFILE_H
+#define ITERATIONFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "IterationMap.h"
+
+#define ITERATION_FILE_MAGIC "MANDITER"
+#define ITERATION_FILE_VERSION 1
+
+typedef struct IterationFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t elementSize;
+	u_int64_t resolution;
+	u_int64_t max_iterations;
+	double centerReal;
+	double centerImaginary;
+	double scale;
+	double threshold;
+} IterationFileHeader;
+
+//Fills header for a map rendered with these parameters, with the magic, version and element width filled in
+void IterationFileHeaderInit(IterationFileHeader* header, const IterationMap* map, u_int64_t resolution, u_int64_t max_iterations, double centerReal, double centerImaginary, double scale, double threshold);
+
+//Writes header and the counts of map to outputfile. Returns 0 on success and 1 if the file could not be written.
+int WriteIterationFile(FILE* outputfile, const IterationFileHeader* header, const IterationMap* map);
+
+/*
+An iteration map file mapped into memory. map.data points into the mapping, which is read only.
+*/
+typedef struct IterationFile
+{
+	const IterationFileHeader* header;
+	IterationMap map;
+	void* mapping;
+	size_t length;
+} IterationFile;
+
+//Returns 1 if the first bytes of a file, length of them, start an iteration map file
+int IsIterationFile(const void* start, size_t length);
+
+//Maps filename into memory and checks its header. Prints what is wrong and returns NULL if it is not a valid file.
+IterationFile* openIterationFile(const char* filename);
+
+//Unmaps the file and frees file
+void closeIterationFile(IterationFile* file);
+
+#endif
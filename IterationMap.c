@@ -0,0 +1,69 @@
+/*********************
+**  Iteration maps
+**  A square grid of iteration counts, stored with the narrowest element type that can hold max_iterations.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "IterationMap.h"
+
+int IterationMapElementSize(u_int64_t max_iterations)
+{
+	if (max_iterations <= UINT16_MAX) {
+		return 2;
+	}
+	if (max_iterations <= UINT32_MAX) {
+		return 4;
+	}
+	return 8;
+}
+
+IterationMap* newIterationMap(u_int64_t resolution, u_int64_t max_iterations)
+{
+	IterationMap* map = (IterationMap*) malloc(sizeof(IterationMap));
+	if (map == NULL) {
+		return NULL;
+	}
+	map->size = 2 * resolution + 1;
+	map->elementSize = IterationMapElementSize(max_iterations);
+	map->data = malloc(map->size * map->size * map->elementSize);
+	if (map->data == NULL) {
+		free(map);
+		return NULL;
+	}
+	return map;
+}
+
+IterationMap* newIterationBand(u_int64_t resolution, u_int64_t max_iterations, u_int64_t rows)
+{
+	IterationMap* map = (IterationMap*) malloc(sizeof(IterationMap));
+	if (map == NULL) {
+		return NULL;
+	}
+	map->size = 2 * resolution + 1;
+	map->elementSize = IterationMapElementSize(max_iterations);
+	map->data = malloc((rows > 0 ? rows : 1) * map->size * map->elementSize);
+	if (map->data == NULL) {
+		free(map);
+		return NULL;
+	}
+	return map;
+}
+
+IterationMap IterationMapWrap(u_int64_t* data, u_int64_t size)
+{
+	IterationMap map;
+	map.size = size;
+	map.elementSize = 8;
+	map.data = data;
+	return map;
+}
+
+void freeIterationMap(IterationMap* map)
+{
+	if (map == NULL) {
+		return;
+	}
+	free(map->data);
+	free(map);
+}
@@ -0,0 +1,85 @@
+/*********************
+**  Iteration maps
+**  A square grid of iteration counts, stored with the narrowest element type that can hold max_iterations.
+**  Most renders use max_iterations well below 65536, so a map usually takes 2 bytes per pixel instead of 8.
+**********************/
+
+#ifndef ITERATIONMAP_H
+#define ITERATIONMAP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct IterationMap
+{
+	u_int64_t size;   //Pixels in one row/column, 2 * resolution + 1
+	int elementSize;  //Bytes per count: 2 (uint16_t), 4 (uint32_t) or 8 (u_int64_t)
+	void* data;       //size * size counts, row by row from the top left corner
+} IterationMap;
+
+//Returns the number of bytes needed to store counts from 0 to max_iterations: 2, 4 or 8
+int IterationMapElementSize(u_int64_t max_iterations);
+
+//Returns a new map for the given resolution whose elements can hold max_iterations, or NULL on failure
+IterationMap* newIterationMap(u_int64_t resolution, u_int64_t max_iterations);
+
+/*
+Returns a map that holds only rows of the rows of a map for the given resolution, or NULL on failure.
+Its size is still the length of a row; only its data is shorter. Freed with freeIterationMap.
+*/
+IterationMap* newIterationBand(u_int64_t resolution, u_int64_t max_iterations, u_int64_t rows);
+
+//Returns a map of 8-byte counts that uses data as its storage. Nothing needs to be freed.
+IterationMap IterationMapWrap(u_int64_t* data, u_int64_t size);
+
+//Frees the map and its data
+void freeIterationMap(IterationMap* map);
+
+//Returns the count stored at position index of an array of elementSize-byte counts
+static inline u_int64_t IterationLoad(const void* data, int elementSize, u_int64_t index)
+{
+	switch (elementSize) {
+	case 2:
+		return ((const uint16_t*) data)[index];
+	case 4:
+		return ((const uint32_t*) data)[index];
+	default:
+		return ((const u_int64_t*) data)[index];
+	}
+}
+
+//Stores value at position index of an array of elementSize-byte counts
+static inline void IterationStore(void* data, int elementSize, u_int64_t index, u_int64_t value)
+{
+	switch (elementSize) {
+	case 2:
+		((uint16_t*) data)[index] = (uint16_t) value;
+		break;
+	case 4:
+		((uint32_t*) data)[index] = (uint32_t) value;
+		break;
+	default:
+		((u_int64_t*) data)[index] = value;
+		break;
+	}
+}
+
+//Returns the count of pixel index, counting row by row
+static inline u_int64_t IterationMapGet(const IterationMap* map, u_int64_t index)
+{
+	return IterationLoad(map->data, map->elementSize, index);
+}
+
+//Sets the count of pixel index, counting row by row
+static inline void IterationMapSet(IterationMap* map, u_int64_t index, u_int64_t value)
+{
+	IterationStore(map->data, map->elementSize, index, value);
+}
+
+//Returns a pointer to the first count of the given row
+static inline void* IterationMapRow(const IterationMap* map, u_int64_t row)
+{
+	return (char*) map->data + row * map->size * map->elementSize;
+}
+
+#endif
@@ -0,0 +1,25 @@
+/*********************
+**  Iteration map text output
+**  The .txt format MandelFrame writes and verify.py reads: every count followed by a space, one row per line.
+**  Rows are formatted into large buffers by a hand-rolled integer-to-decimal routine and written in big chunks,
+**  optionally with several threads formatting row ranges at once.
+**********************/
+
+#ifndef ITERATIONTEXT_H
+#define ITERATIONTEXT_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "IterationMap.h"
+#include "ThreadPool.h"
+
+//Bytes of text formatted before they are handed to fwrite
+#define ITERATION_TEXT_CHUNK (1 << 20)
+
+/*
+Writes every step-th count of every step-th row of map to outputfile; step 1 writes the whole map.
+Formatting is spread over pool when it is not NULL. Returns 0 on success and 1 if the file could not be written.
+*/
+int WriteIterationText(FILE* outputfile, const IterationMap* map, u_int64_t step, ThreadPool* pool);
+
+#endif
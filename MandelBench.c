@@ -0,0 +1,466 @@
+/*********************
+**  Mandelbrot benchmarks
+**  Times the iteration loop, whole renders in double and in float, the row kernels, colorization and PPM writing on fixed views,
+**  and writes the results as JSON so runs can be compared with a stored baseline (make bench).
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "ComplexNumber.h"
+#include "Mandelbrot.h"
+#include "MandelbrotSIMD.h"
+#include "MandelbrotSpecialized.h"
+#include "ColorMapInput.h"
+#include "Palette.h"
+#include "PPMWriter.h"
+
+void printUsage(char* argv[])
+{
+  printf("Usage: %s [options]\n", argv[0]);
+  printf("    Runs every benchmark, prints a summary, and writes the best time of each as JSON\n");
+  printf("    Options:\n");
+  printf("      --output <file>          where the JSON goes (default student_output/bench.json)\n");
+  printf("      --baseline <file>        compare with the JSON of an earlier run, and fail if a benchmark got slower\n");
+  printf("      --tolerance <percent>    slowdown allowed by --baseline before it counts as a regression (default 25)\n");
+  printf("      --repeats <N>            runs of each benchmark; the fastest one is reported (default 5)\n");
+  printf("      --dir <folder>           where the PPM benchmarks write their scratch file (default student_output)\n");
+  printf("      --colorfile <file>       palette used for colorization (default defaultcolormap.txt)\n");
+}
+
+/*
+The fixed views, each sized to take a few milliseconds or more: the partA and testB2 centers for boundary-heavy work,
+a point far outside the set where every pixel escapes within a few iterations, and the main cardioid where almost
+every pixel runs to max_iterations.
+*/
+typedef struct BenchView
+{
+	const char* name;
+	double threshold;
+	u_int64_t max_iterations;
+	double centerReal;
+	double centerImaginary;
+	double scale;
+	u_int64_t resolution;
+} BenchView;
+
+static const BenchView views[] = {
+	{"exterior", 2, 1536, 5, 3, 5, 400},
+	{"interior", 2, 1536, -0.1, 0, 0.3, 100},
+	{"boundaryA", 2, 1536, -0.7746806106269039, -0.1374168856037867, 1e-5, 300},
+	{"boundaryB2", 2, 1536, -0.561397233777, -0.643059076016, 1e-4, 300},
+};
+#define BENCH_VIEWS (sizeof(views) / sizeof(views[0]))
+
+//Resolution of the frame used by the colorization and PPM benchmarks: 1025 x 1025 pixels
+#define BENCH_FRAME_RESOLUTION 512
+
+//One line of the report. iterations is 0 for benchmarks that don't iterate, and bytes is 0 for those that write nothing.
+typedef struct BenchResult
+{
+	char name[64];
+	double seconds;
+	u_int64_t pixels;
+	u_int64_t iterations;
+	u_int64_t bytes;
+} BenchResult;
+
+static double now(void)
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+//The work done by a render that produced counts: points that never escaped ran all max_iterations
+static u_int64_t iterationsOf(const u_int64_t* counts, u_int64_t pixels, u_int64_t max_iterations)
+{
+	u_int64_t total = 0;
+	for (u_int64_t i = 0; i < pixels; i++) {
+		total += counts[i] == 0 ? max_iterations : counts[i];
+	}
+	return total;
+}
+
+/*
+Calls MandelbrotIterations on every pixel of view, with the same pixel positions as Mandelbrot, and stores the counts.
+*/
+static void iterateView(const BenchView* view, u_int64_t* counts)
+{
+	u_int64_t size = 2 * view->resolution + 1;
+	double increments = view->scale / view->resolution;
+	double realStart = view->centerReal - view->scale;
+	double imaginaryStart = view->centerImaginary + view->scale;
+	for (u_int64_t row = 0; row < size; row++) {
+		for (u_int64_t column = 0; column < size; column++) {
+			ComplexNumber* point = newComplexNumber(realStart + increments * column, imaginaryStart - increments * row);
+			counts[row * size + column] = MandelbrotIterations(view->max_iterations, point, view->threshold);
+			freeComplexNumber(point);
+		}
+	}
+}
+
+static void renderView(const BenchView* view, u_int64_t* counts)
+{
+	ComplexNumber* center = newComplexNumber(view->centerReal, view->centerImaginary);
+	Mandelbrot(view->threshold, view->max_iterations, center, view->scale, view->resolution, counts);
+	freeComplexNumber(center);
+}
+
+//The same render in float (see MandelbrotFloat.h), which is faster but not exact
+static void renderFloatView(const BenchView* view, u_int64_t* counts)
+{
+	MandelbrotSettings settings;
+	MandelbrotDefaultSettings(&settings);
+	settings.precision = MANDELBROT_PRECISION_FLOAT;
+	IterationMap map = IterationMapWrap(counts, 2 * view->resolution + 1);
+	ComplexNumber* center = newComplexNumber(view->centerReal, view->centerImaginary);
+	MandelbrotRender(&settings, view->threshold, view->max_iterations, center, view->scale, view->resolution, &map);
+	freeComplexNumber(center);
+}
+
+/*
+The generic SIMD kernels against the ones specialized for threshold 2 at each unroll factor (see MandelbrotSpecialized.h),
+called row by row on the kernelView, which is what MANDELBROT_UNROLL is picked by. Kernels this CPU can't run are skipped.
+*/
+typedef struct BenchKernel
+{
+	const char* name;
+	const char* set; //Instruction set for MandelbrotSIMDSupported
+	MandelbrotRowKernel kernel;
+} BenchKernel;
+
+static const BenchKernel kernels[] = {
+	{"avx2", "avx2", MandelbrotRowAVX2},
+	{"avx2T2U2", "avx2", MandelbrotRowAVX2T2U2},
+	{"avx2T2U4", "avx2", MandelbrotRowAVX2T2U4},
+	{"avx2T2U8", "avx2", MandelbrotRowAVX2T2U8},
+	{"avx512", "avx512", MandelbrotRowAVX512},
+	{"avx512T2U2", "avx512", MandelbrotRowAVX512T2U2},
+	{"avx512T2U4", "avx512", MandelbrotRowAVX512T2U4},
+	{"avx512T2U8", "avx512", MandelbrotRowAVX512T2U8},
+};
+#define BENCH_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static const BenchView kernelView = {"", 2, 1536, -0.561397233777, -0.643059076016, 1e-4, 300};
+
+//The kernel kernelRows runs, since benchView only passes the view along
+static MandelbrotRowKernel benchKernel;
+
+static void kernelRows(const BenchView* view, u_int64_t* counts)
+{
+	u_int64_t size = 2 * view->resolution + 1;
+	MandelbrotRow row;
+	row.maxiters = view->max_iterations;
+	row.thresholdSquared = ComplexAbsSquaredThreshold(view->threshold);
+	row.realStart = view->centerReal - view->scale;
+	row.increments = view->scale / view->resolution;
+	row.interior = 0;
+	row.stride = 1;
+	for (u_int64_t i = 0; i < size; i++) {
+		row.imaginary = (view->centerImaginary + view->scale) - (row.increments * i);
+		benchKernel(&row, 0, size, counts + i * size, sizeof(u_int64_t));
+	}
+}
+
+//Runs view through function repeats times and records the fastest run. Returns 0 on success and 1 on failure.
+static int benchView(BenchResult* result, const char* kind, const BenchView* view, void (*function)(const BenchView*, u_int64_t*), int repeats)
+{
+	u_int64_t size = 2 * view->resolution + 1;
+	u_int64_t* counts = (u_int64_t*) malloc(size * size * sizeof(u_int64_t));
+	if (counts == NULL) {
+		return 1;
+	}
+	snprintf(result->name, sizeof(result->name), "%s/%s", kind, view->name);
+	result->seconds = -1;
+	for (int i = 0; i < repeats; i++) {
+		double start = now();
+		function(view, counts);
+		double seconds = now() - start;
+		if (result->seconds < 0 || seconds < result->seconds) {
+			result->seconds = seconds;
+		}
+	}
+	result->pixels = size * size;
+	result->iterations = iterationsOf(counts, size * size, view->max_iterations);
+	result->bytes = 0;
+	free(counts);
+	return 0;
+}
+
+//The frame the colorization and PPM benchmarks work on: the first frame of testB2, counts and colors
+typedef struct BenchFrame
+{
+	u_int64_t size;
+	IterationMap* iterations;
+	PaletteTable* palette;
+	uint8_t* pixels;
+} BenchFrame;
+
+static void freeBenchFrame(BenchFrame* frame)
+{
+	freeIterationMap(frame->iterations);
+	freePaletteTable(frame->palette);
+	free(frame->pixels);
+}
+
+//Returns 0 on success and 1 on failure
+static int newBenchFrame(BenchFrame* frame, char* colorfile)
+{
+	u_int64_t max_iterations = 1536;
+	memset(frame, 0, sizeof(BenchFrame));
+	frame->size = 2 * BENCH_FRAME_RESOLUTION + 1;
+	int colorcount;
+	uint8_t** colorMap = FileToColorMap(colorfile, &colorcount);
+	if (colorMap == NULL) {
+		return 1;
+	}
+	Palette* palette = newPalette(colorMap, colorcount);
+	freeDoublePointer(colorMap, &colorcount);
+	frame->palette = palette != NULL ? newPaletteTable(palette, max_iterations) : NULL;
+	freePalette(palette);
+	frame->iterations = newIterationMap(BENCH_FRAME_RESOLUTION, max_iterations);
+	frame->pixels = (uint8_t*) malloc(3 * frame->size * frame->size);
+	if (frame->palette == NULL || frame->iterations == NULL || frame->pixels == NULL) {
+		freeBenchFrame(frame);
+		return 1;
+	}
+	ComplexNumber* center = newComplexNumber(-0.561397233777, -0.643059076016);
+	MandelbrotRender(NULL, 2, max_iterations, center, 2, BENCH_FRAME_RESOLUTION, frame->iterations);
+	freeComplexNumber(center);
+	return 0;
+}
+
+static int benchColorize(BenchResult* result, BenchFrame* frame, int repeats)
+{
+	snprintf(result->name, sizeof(result->name), "colorize");
+	result->seconds = -1;
+	for (int i = 0; i < repeats; i++) {
+		double start = now();
+		PaletteColorizeMap(frame->palette, frame->iterations, frame->pixels);
+		double seconds = now() - start;
+		if (result->seconds < 0 || seconds < result->seconds) {
+			result->seconds = seconds;
+		}
+	}
+	result->pixels = frame->size * frame->size;
+	result->iterations = 0;
+	result->bytes = 0;
+	return 0;
+}
+
+//Times WritePPM of the colored frame into a scratch file in folder, which is removed afterwards
+static int benchPPM(BenchResult* result, BenchFrame* frame, int format, const char* folder, int repeats)
+{
+	/* "/bench", up to 11 characters of process id, ".ppm" and the terminator */
+	char* filename = (char*) malloc((sizeof(char)) * (22 + (strlen(folder))));
+	if (filename == NULL) {
+		return 1;
+	}
+	sprintf(filename, "%s/bench%d.ppm", folder, getpid());
+	snprintf(result->name, sizeof(result->name), "ppm/P%d", format);
+	result->seconds = -1;
+	for (int i = 0; i < repeats; i++) {
+		double start = now();
+		int failed = WritePPM(filename, format, frame->size, frame->size, frame->pixels);
+		double seconds = now() - start;
+		if (failed) {
+			printf("Unable to write %s\n", filename);
+			unlink(filename);
+			free(filename);
+			return 1;
+		}
+		if (result->seconds < 0 || seconds < result->seconds) {
+			result->seconds = seconds;
+		}
+	}
+	FILE* file = fopen(filename, "r");
+	if (file == NULL) {
+		free(filename);
+		return 1;
+	}
+	fseek(file, 0, SEEK_END);
+	result->bytes = ftell(file);
+	fclose(file);
+	unlink(filename);
+	free(filename);
+	result->pixels = frame->size * frame->size;
+	result->iterations = 0;
+	return 0;
+}
+
+//Writes the report. Every benchmark sits on a line of its own, which is what readBaseline relies on.
+static void writeReport(FILE* file, const BenchResult* results, int count, int repeats)
+{
+	fprintf(file, "{\n  \"repeats\": %d,\n  \"benchmarks\": [\n", repeats);
+	for (int i = 0; i < count; i++) {
+		const BenchResult* result = &results[i];
+		fprintf(file, "    {\"name\": \"%s\", \"seconds\": %.9f, \"pixels\": %lu, \"pixels_per_second\": %.6e",
+			result->name, result->seconds, result->pixels, result->pixels / result->seconds);
+		if (result->iterations > 0) {
+			fprintf(file, ", \"iterations\": %lu, \"iterations_per_second\": %.6e, \"ns_per_iteration\": %.4f",
+				result->iterations, result->iterations / result->seconds, result->seconds * 1e9 / result->iterations);
+		}
+		if (result->bytes > 0) {
+			fprintf(file, ", \"bytes\": %lu, \"bytes_per_second\": %.6e", result->bytes, result->bytes / result->seconds);
+		}
+		fprintf(file, "}%s\n", i + 1 < count ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+}
+
+/*
+Looks up the seconds of benchmark name in a report written by writeReport.
+Returns 0 and sets seconds if it is there, and 1 otherwise.
+*/
+static int readBaseline(const char* filename, const char* name, double* seconds)
+{
+	FILE* file = fopen(filename, "r");
+	if (file == NULL) {
+		return 1;
+	}
+	char key[128];
+	snprintf(key, sizeof(key), "{\"name\": \"%s\", \"seconds\": ", name);
+	char line[1024];
+	int found = 0;
+	while (!found && fgets(line, sizeof(line), file) != NULL) {
+		char* entry = strstr(line, key);
+		found = entry != NULL && sscanf(entry + strlen(key), "%lf", seconds) == 1;
+	}
+	fclose(file);
+	return !found;
+}
+
+/*
+Prints one line per benchmark, with its change from baseline if baseline is not NULL.
+Returns the number of benchmarks that got more than tolerance percent slower than the baseline.
+*/
+static int printSummary(const BenchResult* results, int count, const char* baseline, double tolerance)
+{
+	int regressions = 0;
+	printf("%-22s %12s %14s %12s", "benchmark", "seconds", "Mpixels/s", "ns/iter");
+	printf(baseline != NULL ? " %12s %8s\n" : "\n", "baseline", "change");
+	for (int i = 0; i < count; i++) {
+		const BenchResult* result = &results[i];
+		printf("%-22s %12.6f %14.3f", result->name, result->seconds, result->pixels / result->seconds * 1e-6);
+		if (result->iterations > 0) {
+			printf(" %12.4f", result->seconds * 1e9 / result->iterations);
+		}
+		else {
+			printf(" %12s", "-");
+		}
+		double seconds;
+		if (baseline == NULL) {
+			printf("\n");
+		}
+		else if (readBaseline(baseline, result->name, &seconds)) {
+			printf(" %12s\n", "-");
+		}
+		else {
+			double change = (result->seconds / seconds - 1) * 100;
+			int regressed = change > tolerance;
+			regressions += regressed;
+			printf(" %12.6f %+7.1f%%%s\n", seconds, change, regressed ? "  REGRESSION" : "");
+		}
+	}
+	return regressions;
+}
+
+int main(int argc, char* argv[])
+{
+	char* output = "student_output/bench.json";
+	char* baseline = NULL;
+	char* folder = "student_output";
+	char* colorfile = "defaultcolormap.txt";
+	double tolerance = 25;
+	int repeats = 5;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+			baseline = argv[++i];
+		}
+		else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+			tolerance = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) {
+			repeats = atoi(argv[++i]);
+			if (repeats < 1) {
+				printf("%s: The number of repeats must be > 0\n", argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+			folder = argv[++i];
+		}
+		else if (strcmp(argv[i], "--colorfile") == 0 && i + 1 < argc) {
+			colorfile = argv[++i];
+		}
+		else {
+			printf("%s: Unknown option %s\n", argv[0], argv[i]);
+			printUsage(argv);
+			return 1;
+		}
+	}
+
+	BenchResult results[3 * BENCH_VIEWS + BENCH_KERNELS + 3];
+	int count = 0;
+	int failed = 0;
+	for (u_int64_t i = 0; i < BENCH_VIEWS && !failed; i++) {
+		failed = benchView(&results[count++], "iterations", &views[i], iterateView, repeats);
+	}
+	for (u_int64_t i = 0; i < BENCH_VIEWS && !failed; i++) {
+		failed = benchView(&results[count++], "render", &views[i], renderView, repeats);
+	}
+	for (u_int64_t i = 0; i < BENCH_VIEWS && !failed; i++) {
+		failed = benchView(&results[count++], "renderFloat", &views[i], renderFloatView, repeats);
+	}
+	for (u_int64_t i = 0; i < BENCH_KERNELS && !failed; i++) {
+		if (MandelbrotSIMDSupported(kernels[i].set)) {
+			BenchView view = kernelView;
+			view.name = kernels[i].name;
+			benchKernel = kernels[i].kernel;
+			failed = benchView(&results[count++], "kernel", &view, kernelRows, repeats);
+		}
+	}
+	BenchFrame frame;
+	if (!failed) {
+		failed = newBenchFrame(&frame, colorfile);
+		if (!failed) {
+			failed = benchColorize(&results[count++], &frame, repeats)
+				|| benchPPM(&results[count++], &frame, PPM_P6, folder, repeats)
+				|| benchPPM(&results[count++], &frame, PPM_P3, folder, repeats);
+			freeBenchFrame(&frame);
+		}
+	}
+	if (failed) {
+		printf("%s: Unable to run the benchmarks\n", argv[0]);
+		return 1;
+	}
+
+	FILE* file = fopen(output, "w");
+	if (file != NULL) {
+		writeReport(file, results, count, repeats);
+	}
+	if (file == NULL || fclose(file) != 0) {
+		printf("Unable to write %s\n", output);
+		return 1;
+	}
+	if (baseline != NULL && access(baseline, R_OK) != 0) {
+		printf("Unable to read baseline %s\n", baseline);
+		return 1;
+	}
+	printf("\n");
+	int regressions = printSummary(results, count, baseline, tolerance);
+	printf("Results written to %s\n", output);
+	if (regressions > 0) {
+		printf("%d benchmarks are more than %.1f%% slower than %s\n", regressions, tolerance, baseline);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,209 @@
+/*********************
+**  Render contexts
+**  Cached state is checked and rebuilt under one lock in MandelContextPrepare;
+**  the renders themselves only read it, so they run without holding anything.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "MandelContext.h"
+#include "ColorMapInput.h"
+
+struct MandelContext
+{
+	MandelbrotSettings settings;
+	int perturbation;
+	Palette* palette;
+	PaletteTable* table;
+	u_int64_t tableIterations;  //max_iterations table was made for
+	PerturbationOrbit* orbit;
+	IterationMap* scratch;
+	u_int64_t scratchResolution;
+	pthread_mutex_t lock;
+};
+
+MandelContext* newMandelContext(const MandelbrotSettings* settings, int threads)
+{
+	MandelContext* context = (MandelContext*) calloc(1, sizeof(MandelContext));
+	if (context == NULL) {
+		return NULL;
+	}
+	if (settings != NULL) {
+		context->settings = *settings;
+	}
+	else {
+		MandelbrotDefaultSettings(&context->settings);
+	}
+	context->settings.pool = NULL;
+	context->settings.perturbation = NULL;
+	if (threads > 1) {
+		context->settings.pool = newThreadPool(threads);
+		if (context->settings.pool == NULL) {
+			free(context);
+			return NULL;
+		}
+	}
+	pthread_mutex_init(&context->lock, NULL);
+	return context;
+}
+
+void freeMandelContext(MandelContext* context)
+{
+	if (context == NULL) {
+		return;
+	}
+	freeThreadPool(context->settings.pool);
+	freePaletteTable(context->table);
+	freePalette(context->palette);
+	freePerturbationOrbit(context->orbit);
+	freeIterationMap(context->scratch);
+	pthread_mutex_destroy(&context->lock);
+	free(context);
+}
+
+MandelbrotSettings* MandelContextSettings(MandelContext* context)
+{
+	return &context->settings;
+}
+
+ThreadPool* MandelContextPool(MandelContext* context)
+{
+	return context->settings.pool;
+}
+
+void MandelContextSetPerturbation(MandelContext* context, int perturbation)
+{
+	context->perturbation = perturbation;
+}
+
+int MandelContextLoadPalette(MandelContext* context, char* colorfile)
+{
+	int colorcount;
+	uint8_t** colorMap = FileToColorMap(colorfile, &colorcount);
+	if (colorMap == NULL) {
+		return 1;
+	}
+	/* the colors are copied into one flat palette, so colorMap can go right away */
+	Palette* palette = newPalette(colorMap, colorcount);
+	freeDoublePointer(colorMap, &colorcount);
+	if (palette == NULL) {
+		return 1;
+	}
+	pthread_mutex_lock(&context->lock);
+	freePaletteTable(context->table);
+	freePalette(context->palette);
+	context->palette = palette;
+	context->table = NULL;
+	pthread_mutex_unlock(&context->lock);
+	return 0;
+}
+
+const MandelbrotSettings* MandelContextPrepare(MandelContext* context, const MandelView* view)
+{
+	int failed = 0;
+	pthread_mutex_lock(&context->lock);
+	if (context->palette != NULL && (context->table == NULL || context->tableIterations != view->max_iterations)) {
+		freePaletteTable(context->table);
+		context->table = newPaletteTable(context->palette, view->max_iterations);
+		context->tableIterations = view->max_iterations;
+		failed = context->table == NULL;
+	}
+	ComplexNumber* center = newComplexNumber(view->centerReal, view->centerImaginary);
+	failed = failed || center == NULL;
+	if (!failed && !context->perturbation) {
+		context->settings.perturbation = NULL;
+	}
+	else if (!failed && (context->orbit == NULL || !PerturbationOrbitMatches(context->orbit, center, view->max_iterations, view->threshold))) {
+		freePerturbationOrbit(context->orbit);
+		context->orbit = newPerturbationOrbit(center, view->max_iterations, view->threshold);
+		context->settings.perturbation = context->orbit;
+		failed = context->orbit == NULL;
+	}
+	else if (!failed) {
+		context->settings.perturbation = context->orbit;
+	}
+	freeComplexNumber(center);
+	pthread_mutex_unlock(&context->lock);
+	return failed ? NULL : &context->settings;
+}
+
+const PaletteTable* MandelContextPalette(MandelContext* context)
+{
+	return context->table;
+}
+
+IterationMap* MandelContextMap(MandelContext* context, const MandelView* view)
+{
+	if (context->scratch != NULL && context->scratchResolution == view->resolution
+		&& context->scratch->elementSize == IterationMapElementSize(view->max_iterations)) {
+		return context->scratch;
+	}
+	freeIterationMap(context->scratch);
+	context->scratch = newIterationMap(view->resolution, view->max_iterations);
+	context->scratchResolution = view->resolution;
+	return context->scratch;
+}
+
+int MandelRenderMap(MandelContext* context, const MandelView* view, IterationMap* out)
+{
+	const MandelbrotSettings* settings = MandelContextPrepare(context, view);
+	ComplexNumber* center = newComplexNumber(view->centerReal, view->centerImaginary);
+	if (settings == NULL || center == NULL) {
+		freeComplexNumber(center);
+		return 1;
+	}
+	MandelbrotRender(settings, view->threshold, view->max_iterations, center, view->scale, view->resolution, out);
+	freeComplexNumber(center);
+	return 0;
+}
+
+int MandelRenderProgressive(MandelContext* context, const MandelView* view, IterationMap* out, MandelbrotPassCallback callback, void* arg)
+{
+	const MandelbrotSettings* settings = MandelContextPrepare(context, view);
+	ComplexNumber* center = newComplexNumber(view->centerReal, view->centerImaginary);
+	if (settings == NULL || center == NULL) {
+		freeComplexNumber(center);
+		return 1;
+	}
+	MandelbrotProgressive(settings, view->threshold, view->max_iterations, center, view->scale, view->resolution, out, callback, arg);
+	freeComplexNumber(center);
+	return 0;
+}
+
+int MandelRenderBand(MandelContext* context, const MandelView* view, u_int64_t firstRow, u_int64_t rows, IterationMap* out)
+{
+	const MandelbrotSettings* settings = MandelContextPrepare(context, view);
+	ComplexNumber* center = newComplexNumber(view->centerReal, view->centerImaginary);
+	if (settings == NULL || center == NULL) {
+		freeComplexNumber(center);
+		return 1;
+	}
+	MandelbrotRenderRows(settings, view->threshold, view->max_iterations, center, view->scale, view->resolution, firstRow, rows, out);
+	freeComplexNumber(center);
+	return 0;
+}
+
+int MandelRenderFrame(MandelContext* context, const MandelView* view, uint8_t* out)
+{
+	const MandelbrotSettings* settings = MandelContextPrepare(context, view);
+	if (settings == NULL || context->table == NULL) {
+		return 1;
+	}
+	if (settings->subdivide) {
+		/* subdivision needs the counts of whole tiles, so they go through the scratch map */
+		IterationMap* map = MandelContextMap(context, view);
+		if (map == NULL || MandelRenderMap(context, view, map)) {
+			return 1;
+		}
+		PaletteColorizeMap(context->table, map, out);
+		return 0;
+	}
+	ComplexNumber* center = newComplexNumber(view->centerReal, view->centerImaginary);
+	if (center == NULL) {
+		return 1;
+	}
+	MandelbrotRenderRGB(settings, view->threshold, view->max_iterations, center, view->scale, view->resolution, context->table, out);
+	freeComplexNumber(center);
+	return 0;
+}
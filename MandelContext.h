@@ -0,0 +1,84 @@
+/*********************
+**  Render contexts
+**  The public face of libmandel: everything a long-running process needs to render frame after frame
+**  without redoing any setup. A context owns the thread pool, the palette and its lookup table,
+**  the reference orbit for perturbation, and a scratch iteration map, and keeps all of them
+**  between calls for as long as the views allow.
+**  Several threads may render with one context at the same time, as long as their views share threshold,
+**  max_iterations and center (as the frames of a movie do) and none of them uses the scratch map.
+**********************/
+
+#ifndef MANDELCONTEXT_H
+#define MANDELCONTEXT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "Mandelbrot.h"
+
+//One frame: the arguments of MandelbrotRender, with the center as plain numbers
+typedef struct MandelView
+{
+	double threshold;
+	u_int64_t max_iterations;
+	double centerReal;
+	double centerImaginary;
+	double scale;
+	u_int64_t resolution;
+} MandelView;
+
+typedef struct MandelContext MandelContext;
+
+/*
+Returns a new context rendering with a copy of settings (NULL for the defaults) on threads threads,
+where 1 renders on the calling thread. Returns NULL on failure.
+*/
+MandelContext* newMandelContext(const MandelbrotSettings* settings, int threads);
+
+//Frees the context and everything it owns
+void freeMandelContext(MandelContext* context);
+
+//The settings renders use. The kernel, interior, subdivide, tileSize and series fields may be changed between renders; the pool and perturbation fields belong to the context.
+MandelbrotSettings* MandelContextSettings(MandelContext* context);
+
+//Returns the context's thread pool, or NULL if it renders on the calling thread
+ThreadPool* MandelContextPool(MandelContext* context);
+
+//With perturbation set, renders go by perturbation around a reference orbit at the view's center, which is kept for the next view with the same center
+void MandelContextSetPerturbation(MandelContext* context, int perturbation);
+
+//Reads the palette from colorfile (see FileToColorMap). Returns 0 on success and 1 on failure.
+int MandelContextLoadPalette(MandelContext* context, char* colorfile);
+
+/*
+Gets everything view needs ready: the palette table for its max_iterations and, with perturbation, the reference
+orbit at its center. Both are kept until a view with a different max_iterations or center comes along.
+Returns the settings to hand to MandelbrotRender for view, or NULL on failure.
+*/
+const MandelbrotSettings* MandelContextPrepare(MandelContext* context, const MandelView* view);
+
+//The palette table prepared for the last view, or NULL if no palette is loaded
+const PaletteTable* MandelContextPalette(MandelContext* context);
+
+/*
+Returns the context's scratch iteration map, sized for view. It is only reallocated when a view needs a different
+size or element width. Its contents are overwritten by the next render that uses it. NULL on failure.
+*/
+IterationMap* MandelContextMap(MandelContext* context, const MandelView* view);
+
+//Renders the iteration counts of view into out, a map made for its resolution and max_iterations. Returns 0 on success and 1 on failure.
+int MandelRenderMap(MandelContext* context, const MandelView* view, IterationMap* out);
+
+//MandelRenderMap, coarse to fine, with a callback after each pass (see MandelbrotProgressive)
+int MandelRenderProgressive(MandelContext* context, const MandelView* view, IterationMap* out, MandelbrotPassCallback callback, void* arg);
+
+//MandelRenderMap for rows firstRow to firstRow + rows - 1 only, into a band made by newIterationBand (see MandelbrotRenderRows)
+int MandelRenderBand(MandelContext* context, const MandelView* view, u_int64_t firstRow, u_int64_t rows, IterationMap* out);
+
+/*
+Renders view in the context's palette into out, 3 bytes per pixel row by row (the pixel data of a P6 image).
+Without subdivision, colors are produced tile by tile and no iteration map is touched; with it, the scratch map is used.
+Returns 0 on success and 1 on failure.
+*/
+int MandelRenderFrame(MandelContext* context, const MandelView* view, uint8_t* out);
+
+#endif
@@ -9,12 +9,130 @@
 #include <stdlib.h>
 #include "ComplexNumber.h"
 #include "Mandelbrot.h"
+#include "MandelContext.h"
+#include "IterationText.h"
+#include "IterationFile.h"
+#include "Shard.h"
+#include "Instrument.h"
 #include <sys/types.h>
+#include <string.h>
+#include <time.h>
 
 void printUsage(char* argv[])
 {
-  printf("Usage: %s <threshold> <maxiterations> <center_real> <center_imaginary> <scale> <resolution> <output_file>\n", argv[0]);
+  printf("Usage: %s <threshold> <maxiterations> <center_real> <center_imaginary> <scale> <resolution> <output_file> [options]\n", argv[0]);
   printf("    This program simulates the Mandelbrot Fractal, and creates an iteration map of the given center, scale, and resolution, then saves it in output_file\n");
+  printf("    Options:\n");
+  printf("      --kernel <auto|scalar|avx2|avx512>   row kernel used for the calculation (default auto)\n");
+  printf("      --interior <off|bulbs|cycles|all>    exact shortcuts for points inside the set (default off)\n");
+  printf("      --precision <double|float|auto>      arithmetic of the row kernel: only double is exact; auto uses float for shallow views (default double)\n");
+  printf("      --precision-report                   also render the view in float and in double, and print how many pixels differ\n");
+  printf("      --subdivide                          skip uniform regions by Mariani-Silver subdivision; faster but not exact\n");
+  printf("      --threads <N>                        number of threads rendering tiles (default 1)\n");
+  printf("      --perturbation                       render by perturbation around a high-precision orbit at the center, for scales below 1e-13\n");
+  printf("      --series                             with --perturbation, skip early iterations by series approximation\n");
+  printf("      --binary                             write output_file as a binary iteration map file (see IterationFile.h) instead of text\n");
+  printf("      --progressive                        render every 8th, 4th, 2nd, then every pixel, writing each coarse pass to <output_file>.preview<step>\n");
+  printf("      --shard <i>/<N>                      render only band i of N bands of rows, and write output_file as a band file;\n");
+  printf("                                           MandelMerge puts the N band files back together into the whole map\n");
+  printf("      --instrument <file>                  write per-tile timings and iteration statistics to file as JSON lines\n");
+  printf("                                           (only in builds made with make INSTRUMENT=1)\n");
+}
+
+//Where the previews of a progressive render go, and the pool that formats them
+typedef struct PreviewTarget
+{
+	char* output_file;
+	ThreadPool* pool;
+} PreviewTarget;
+
+//Writes the preview of each coarse pass next to the output file
+static void writePreview(void* arg, u_int64_t step, const IterationMap* map)
+{
+	PreviewTarget* target = (PreviewTarget*) arg;
+	if (step == 1) {
+		return;
+	}
+	/* ".preview", up to 20 digits and the terminator */
+	char* filename = (char*) malloc((sizeof(char)) * (29 + (strlen(target->output_file))));
+	if (filename == NULL) {
+		printf("memory allocation problems");
+		return;
+	}
+	sprintf(filename, "%s.preview%lu", target->output_file, step);
+	FILE* previewfile = fopen(filename, "w");
+	if (previewfile == NULL) {
+		printf("Unable to write preview %s\n", filename);
+		free(filename);
+		return;
+	}
+	int failed = WriteIterationText(previewfile, map, step, target->pool);
+	if (fclose(previewfile) != 0 || failed) {
+		printf("Unable to write preview %s\n", filename);
+	}
+	else {
+		printf("Preview with a spacing of %lu pixels written to %s\n", step, filename);
+	}
+	free(filename);
+}
+
+//Seconds on a monotonic clock
+static double secondsNow()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+Renders view in double and in float through context, and prints how many pixels differ, by how much,
+how long each took, and which of the two --precision auto would use. Returns 0 on success and 1 on failure.
+*/
+static int reportPrecision(MandelContext* context, const MandelView* view)
+{
+	MandelbrotSettings* settings = MandelContextSettings(context);
+	int precision = settings->precision;
+	IterationMap* exact = newIterationMap(view->resolution, view->max_iterations);
+	IterationMap* fast = newIterationMap(view->resolution, view->max_iterations);
+	int failed = exact == NULL || fast == NULL;
+	double start = secondsNow();
+	double exactSeconds = 0;
+	double fastSeconds = 0;
+	if (!failed) {
+		settings->precision = MANDELBROT_PRECISION_DOUBLE;
+		failed = MandelRenderMap(context, view, exact);
+		exactSeconds = secondsNow() - start;
+	}
+	if (!failed) {
+		start = secondsNow();
+		settings->precision = MANDELBROT_PRECISION_FLOAT;
+		failed = MandelRenderMap(context, view, fast);
+		fastSeconds = secondsNow() - start;
+	}
+	settings->precision = precision;
+	if (failed) {
+		printf("Unable to render the precision report\n");
+		freeIterationMap(exact);
+		freeIterationMap(fast);
+		return 1;
+	}
+	u_int64_t pixels = exact->size * exact->size;
+	u_int64_t mismatches = 0;
+	u_int64_t largest = 0;
+	for (u_int64_t i = 0; i < pixels; i++) {
+		u_int64_t a = IterationMapGet(exact, i);
+		u_int64_t b = IterationMapGet(fast, i);
+		u_int64_t difference = a > b ? a - b : b - a;
+		mismatches += difference != 0;
+		largest = difference > largest ? difference : largest;
+	}
+	printf("Precision report: float differs from double at %lu of %lu pixels (%.4f%%), by at most %lu iterations\n",
+		mismatches, pixels, 100.0 * mismatches / pixels, largest);
+	printf("    double took %.3f s, float %.3f s; --precision auto uses %s for this view\n", exactSeconds, fastSeconds,
+		MandelbrotUsesFloat(MANDELBROT_PRECISION_AUTO, view->centerReal, view->centerImaginary, view->scale, view->resolution, view->max_iterations) ? "float" : "double");
+	freeIterationMap(exact);
+	freeIterationMap(fast);
+	return 0;
 }
 
 	/**************
@@ -28,11 +146,83 @@ void printUsage(char* argv[])
 
 	//STEP 1: Convert command line inputs to local variables, and ensure that inputs are valid.
 	// Check number of args
-	if (argc != 8) {
+	if (argc < 8) {
 		printf("%s: Wrong number of arguments, expecting 7\n", argv[0]);
 		printUsage(argv);
 		return 1;
 	}
+	MandelbrotSettings settings;
+	MandelbrotDefaultSettings(&settings);
+	int threads = 1;
+	int perturbation = 0;
+	int progressive = 0;
+	int binary = 0;
+	int precisionReport = 0;
+	char* instrumentfile = NULL;
+	u_int64_t shard = 0;
+	u_int64_t shards = 0;
+	for (int i = 8; i < argc; i++) {
+		if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+			settings.rowKernel = MandelbrotRowKernelNamed(argv[++i]);
+			if (settings.rowKernel == NULL) {
+				printf("%s: Kernel %s is unknown or not supported by this CPU\n", argv[0], argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--interior") == 0 && i + 1 < argc) {
+			settings.interior = MandelbrotInteriorNamed(argv[++i]);
+			if (settings.interior < 0) {
+				printf("%s: Unknown interior shortcut %s\n", argv[0], argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+			settings.precision = MandelbrotPrecisionNamed(argv[++i]);
+			if (settings.precision < 0) {
+				printf("%s: Unknown precision %s\n", argv[0], argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--precision-report") == 0) {
+			precisionReport = 1;
+		}
+		else if (strcmp(argv[i], "--subdivide") == 0) {
+			settings.subdivide = 1;
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+			if (threads < 1) {
+				printf("%s: The number of threads must be > 0\n", argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--perturbation") == 0) {
+			perturbation = 1;
+		}
+		else if (strcmp(argv[i], "--series") == 0) {
+			settings.series = 1;
+		}
+		else if (strcmp(argv[i], "--progressive") == 0) {
+			progressive = 1;
+		}
+		else if (strcmp(argv[i], "--binary") == 0) {
+			binary = 1;
+		}
+		else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+			if (ParseShard(argv[++i], &shard, &shards)) {
+				printf("%s: Expected --shard <i>/<N> with 0 <= i < N <= %d, not %s\n", argv[0], SHARD_MAX, argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--instrument") == 0 && i + 1 < argc) {
+			instrumentfile = argv[++i];
+		}
+		else {
+			printf("%s: Unknown option %s\n", argv[0], argv[i]);
+			printUsage(argv);
+			return 1;
+		}
+	}
 	double threshold, scale;
 	ComplexNumber* center;
 	u_int64_t max_iterations, resolution;
@@ -49,41 +239,132 @@ void printUsage(char* argv[])
 		return 1;
 	}
 	u_int64_t size = 2 * resolution + 1;
+	if (shards > 0 && progressive) {
+		printf("%s: --shard and --progressive cannot be combined\n", argv[0]);
+		freeComplexNumber(center);
+		return 1;
+	}
+	/* every band must hold at least one row */
+	if (shards > size) {
+		printf("%s: The frame has %lu rows, so it cannot be split into %lu shards\n", argv[0], size, shards);
+		freeComplexNumber(center);
+		return 1;
+	}
+	/* a shard only renders its own band of rows */
+	u_int64_t firstRow = 0;
+	u_int64_t rows = size;
+	if (shards > 0) {
+		ShardRows(size, shard, shards, &firstRow, &rows);
+	}
+#ifdef MANDEL_INSTRUMENT
+	if (instrumentfile != NULL && InstrumentOpen(instrumentfile)) {
+		printf("Unable to write %s\n", instrumentfile);
+		freeComplexNumber(center);
+		return 1;
+	}
+#else
+	if (instrumentfile != NULL) {
+		printf("%s: --instrument needs a build with instrumentation (make clean; make INSTRUMENT=1)\n", argv[0]);
+		freeComplexNumber(center);
+		return 1;
+	}
+#endif
 	//END STEP 1
 
-	//STEP 2: Run Mandelbrot on the correct arguments.
-	u_int64_t *ar;
-	ar = (u_int64_t *)malloc(size * size * sizeof(u_int64_t));
+	//STEP 2: Run Mandelbrot on the correct arguments, through a render context that owns the threads and the map.
+	MandelView view = {threshold, max_iterations, Re(center), Im(center), scale, resolution};
+	MandelContext* context = newMandelContext(&settings, threads);
+	if (context == NULL) {
+		printf("Unable to start %d threads\n", threads);
+		freeComplexNumber(center);
+		return 1;
+	}
+	MandelContextSetPerturbation(context, perturbation);
+	IterationMap *ar;
+	ar = shards > 0 ? newIterationBand(resolution, max_iterations, rows) : MandelContextMap(context, &view);
 	if (ar == NULL) {
-		printf("Unable to allocate %lu bytes\n", size * size * sizeof(u_int64_t));
+		printf("Unable to allocate %lu bytes\n", rows * size * IterationMapElementSize(max_iterations));
+		freeMandelContext(context);
+		freeComplexNumber(center);
 		return 1;
 	}
 	printf("Beginning calculation of Mandelbrot grid centered on %lf + %lfi, with scale of %lf, max iterations of %lu, \nthreshold of %lf, and resolution of %lu \n",
 		atof(argv[3]), atof(argv[4]), scale, max_iterations, threshold, resolution);
 
-	Mandelbrot(threshold, max_iterations, center, scale, resolution, ar);
+	INSTRUMENT(InstrumentFrame stats);
+	INSTRUMENT(InstrumentFrameBegin(&stats, 0, scale, max_iterations));
+	INSTRUMENT(InstrumentTime start = InstrumentNow());
+	int failed;
+	if (shards > 0) {
+		printf("Rendering rows %lu to %lu, band %lu of %lu\n", firstRow, firstRow + rows - 1, shard, shards);
+		failed = MandelRenderBand(context, &view, firstRow, rows, ar);
+	}
+	else if (progressive) {
+		PreviewTarget target = {argv[7], MandelContextPool(context)};
+		failed = MandelRenderProgressive(context, &view, ar, writePreview, &target);
+	}
+	else {
+		failed = MandelRenderMap(context, &view, ar);
+	}
+	INSTRUMENT(InstrumentStageEnd(&stats, INSTRUMENT_RENDER, start));
+	if (failed) {
+		/* the only thing a render allocates is the reference orbit */
+		printf("Unable to allocate the reference orbit\n");
+		if (shards > 0) {
+			freeIterationMap(ar);
+		}
+		freeMandelContext(context);
+		freeComplexNumber(center);
+		return 1;
+	}
 
 	printf("Calculation complete, outputting to file %s\n", argv[7]);
+	/* the report renders into maps of its own, so ar keeps the counts that are written out */
+	if (precisionReport && reportPrecision(context, &view)) {
+		if (shards > 0) {
+			freeIterationMap(ar);
+		}
+		freeMandelContext(context);
+		freeComplexNumber(center);
+		return 1;
+	}
 	//END STEP 2
 
-	//STEP 3: Output the results of Mandelbrot to .txt files.
+	//STEP 3: Output the results of Mandelbrot to .txt files, or to a binary iteration map file with --binary, or to a band file with --shard.
+	INSTRUMENT(start = InstrumentNow());
 	FILE* outputfile = fopen(argv[7], "w+");
-	u_int64_t iterations;
-	for (int row = 0; row < size; row++) {
-		for (int col = 0; col < size; col++) {
-			iterations = *(ar + row*size + col); // ar[row][col];
-
-			fprintf(outputfile, "%lu ", iterations);
-		}
-		fputc('\n', outputfile);
-	}	
-	
-	fclose(outputfile);
+	failed = outputfile == NULL;
+	IterationFileHeader header;
+	IterationFileHeaderInit(&header, ar, resolution, max_iterations, Re(center), Im(center), scale, threshold);
+	if (!failed && shards > 0) {
+		failed = WriteBandFile(outputfile, &header, shard, shards, firstRow, rows, ar);
+	}
+	else if (!failed && binary) {
+		failed = WriteIterationFile(outputfile, &header, ar);
+	}
+	else if (!failed) {
+		failed = WriteIterationText(outputfile, ar, 1, MandelContextPool(context));
+	}
+	if ((outputfile != NULL && fclose(outputfile) != 0) || failed) {
+		printf("Unable to write %s\n", argv[7]);
+		failed = 1;
+	}
+	INSTRUMENT(InstrumentStageEnd(&stats, INSTRUMENT_WRITE, start));
+	INSTRUMENT(InstrumentFrameEnd(&stats));
+#ifdef MANDEL_INSTRUMENT
+	if (InstrumentClose()) {
+		printf("Unable to write %s\n", instrumentfile);
+		failed = 1;
+	}
+#endif
 
 	//END STEP 3
 
 	//STEP 4: Free all allocated memory
+	if (shards > 0) {
+		freeIterationMap(ar);
+	}
+	freeMandelContext(context);
 	freeComplexNumber(center);
-	free(ar);
-	return 0;
+	return failed;
 }
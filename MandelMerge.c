@@ -0,0 +1,211 @@
+/*********************
+**  MandelMerge
+**  Puts the band files of a frame rendered with MandelFrame --shard back together, or checks that the shards of a
+**  movie rendered with MandelMovie --shard have all done their part.
+**  Bands are checked against each other before anything is written: the same frame, the same number of shards,
+**  every shard exactly once, and every band covering exactly the rows its shard number stands for.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "IterationMap.h"
+#include "IterationFile.h"
+#include "IterationText.h"
+#include "Shard.h"
+
+void printUsage(char* argv[])
+{
+  printf("Usage: %s <output_file> <band_file>... [--binary]\n", argv[0]);
+  printf("       %s --frames <output_folder> <framecount> <resolution>\n", argv[0]);
+  printf("    The first form merges the band files written by MandelFrame --shard into output_file, as a .txt iteration map,\n");
+  printf("    or as a binary iteration map file with --binary.\n");
+  printf("    The second form checks that output_folder holds every frame of a movie written by MandelMovie --shard.\n");
+}
+
+//Returns 1 if the two headers describe the same frame
+static int sameFrame(const IterationFileHeader* a, const IterationFileHeader* b)
+{
+	return a->elementSize == b->elementSize && a->resolution == b->resolution && a->max_iterations == b->max_iterations
+		&& a->centerReal == b->centerReal && a->centerImaginary == b->centerImaginary && a->scale == b->scale && a->threshold == b->threshold;
+}
+
+/*
+Opens the count band files in filenames and checks that they make up one whole frame. On success, fills bands,
+indexed by shard number, and returns 0. Otherwise prints the problem, leaves nothing open and returns 1.
+*/
+static int openBands(char** filenames, int count, BandFile** bands)
+{
+	memset(bands, 0, count * sizeof(BandFile*));
+	int failed = 0;
+	const BandFileHeader* first = NULL;
+	for (int i = 0; i < count && !failed; i++) {
+		BandFile* band = openBandFile(filenames[i]);
+		if (band == NULL) {
+			failed = 1;
+			break;
+		}
+		const BandFileHeader* header = band->header;
+		if (first == NULL) {
+			first = header;
+		}
+		if (header->shards != (u_int64_t) count) {
+			printf("%s is band %lu of %lu, but %d band files were given\n", filenames[i], header->shard, header->shards, count);
+			failed = 1;
+		}
+		else if (!sameFrame(&header->frame, &first->frame)) {
+			printf("%s is a band of a different frame than %s\n", filenames[i], filenames[0]);
+			failed = 1;
+		}
+		else if (bands[header->shard] != NULL) {
+			printf("%s and another file are both band %lu\n", filenames[i], header->shard);
+			failed = 1;
+		}
+		else {
+			u_int64_t firstRow, rows;
+			ShardRows(band->band.size, header->shard, header->shards, &firstRow, &rows);
+			if (header->firstRow != firstRow || header->rows != rows) {
+				printf("%s holds rows %lu to %lu, but band %lu should hold rows %lu to %lu\n", filenames[i],
+					header->firstRow, header->firstRow + header->rows - 1, header->shard, firstRow, firstRow + rows - 1);
+				failed = 1;
+			}
+		}
+		if (!failed) {
+			bands[header->shard] = band;
+		}
+		else {
+			closeBandFile(band);
+		}
+	}
+	if (failed) {
+		for (int i = 0; i < count; i++) {
+			closeBandFile(bands[i]);
+		}
+	}
+	return failed;
+}
+
+//Merges the band files into outputfile. Returns 0 on success and 1 on failure.
+static int mergeBands(char* outputfile, char** filenames, int count, int binary)
+{
+	BandFile** bands = (BandFile**) malloc(count * sizeof(BandFile*));
+	if (bands == NULL) {
+		printf("memory allocation problems");
+		return 1;
+	}
+	if (openBands(filenames, count, bands)) {
+		free(bands);
+		return 1;
+	}
+	const IterationFileHeader* frame = &bands[0]->header->frame;
+	IterationMap* map = newIterationMap(frame->resolution, frame->max_iterations);
+	int failed = map == NULL || map->elementSize != (int) frame->elementSize;
+	if (failed) {
+		printf("Unable to allocate the merged map\n");
+	}
+	for (int i = 0; i < count && !failed; i++) {
+		const BandFileHeader* header = bands[i]->header;
+		memcpy(IterationMapRow(map, header->firstRow), bands[i]->band.data, header->rows * map->size * map->elementSize);
+	}
+	FILE* output = failed ? NULL : fopen(outputfile, "w+");
+	if (!failed && output != NULL) {
+		if (binary) {
+			IterationFileHeader header = *frame;
+			memcpy(header.magic, ITERATION_FILE_MAGIC, sizeof(header.magic));
+			failed = WriteIterationFile(output, &header, map);
+		}
+		else {
+			failed = WriteIterationText(output, map, 1, NULL);
+		}
+	}
+	if (!failed && (output == NULL || fclose(output) != 0)) {
+		printf("Unable to write %s\n", outputfile);
+		failed = 1;
+	}
+	if (!failed) {
+		printf("Merged %d bands of a %lu by %lu map into %s\n", count, map->size, map->size, outputfile);
+	}
+	freeIterationMap(map);
+	for (int i = 0; i < count; i++) {
+		closeBandFile(bands[i]);
+	}
+	free(bands);
+	return failed;
+}
+
+//Checks that output_folder holds frames 0 to framecount - 1 as complete P6 images. Returns 0 if it does and 1 otherwise.
+static int checkFrames(const char* output_folder, int framecount, u_int64_t resolution)
+{
+	u_int64_t size = 2 * resolution + 1;
+	char header[64];
+	int headerLength = snprintf(header, sizeof(header), "P6 %lu %lu 255\n", size, size);
+	u_int64_t expected = headerLength + 3 * size * size;
+	int missing = 0;
+	/* "/frame", up to 10 digits, ".ppm" and the terminator */
+	char* filename = (char*) malloc((sizeof(char)) * (21 + (strlen(output_folder))));
+	if (filename == NULL) {
+		printf("memory allocation problems");
+		return 1;
+	}
+	for (int index = 0; index < framecount; index++) {
+		sprintf(filename, "%s/frame%05d.ppm", output_folder, index);
+		struct stat status;
+		char start[64];
+		FILE* file = fopen(filename, "r");
+		int valid = file != NULL && fstat(fileno(file), &status) == 0 && (u_int64_t) status.st_size == expected
+			&& fread(start, 1, headerLength, file) == (size_t) headerLength && memcmp(start, header, headerLength) == 0;
+		if (file != NULL) {
+			fclose(file);
+		}
+		if (!valid) {
+			printf("%s is missing or incomplete\n", filename);
+			missing++;
+		}
+	}
+	free(filename);
+	if (missing > 0) {
+		printf("%d of %d frames are missing or incomplete\n", missing, framecount);
+		return 1;
+	}
+	printf("All %d frames are in %s\n", framecount, output_folder);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc == 5 && strcmp(argv[1], "--frames") == 0) {
+		int framecount = atoi(argv[3]);
+		int resolution = atoi(argv[4]);
+		if (framecount <= 0 || resolution <= 0) {
+			printf("framecount and resolution must be greater than 0\n");
+			return 1;
+		}
+		return checkFrames(argv[2], framecount, (u_int64_t) resolution);
+	}
+	int binary = 0;
+	char** filenames = (char**) malloc(argc * sizeof(char*));
+	if (filenames == NULL) {
+		printf("memory allocation problems");
+		return 1;
+	}
+	int count = 0;
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--binary") == 0) {
+			binary = 1;
+		}
+		else {
+			filenames[count++] = argv[i];
+		}
+	}
+	if (argc < 3 || count == 0 || argv[1][0] == '-') {
+		printf("%s: Wrong number of arguments\n", argv[0]);
+		printUsage(argv);
+		free(filenames);
+		return 1;
+	}
+	int failed = mergeBands(argv[1], filenames, count, binary);
+	free(filenames);
+	return failed;
+}
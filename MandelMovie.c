@@ -11,35 +11,539 @@
 #include <math.h>
 #include "ComplexNumber.h"
 #include "Mandelbrot.h"
+#include "MandelContext.h"
 #include "ColorMapInput.h"
+#include "Palette.h"
+#include "PPMWriter.h"
+#include "VideoStream.h"
+#include "Instrument.h"
+#include "BoundedQueue.h"
+#include "Shard.h"
+#include "FrameCache.h"
 #include <sys/types.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 
 void printUsage(char* argv[])
 {
-  printf("Usage: %s <threshold> <maxiterations> <center_real> <center_imaginary> <initialscale> <finalscale> <framecount> <resolution> <output_folder> <colorfile>\n", argv[0]);
+  printf("Usage: %s <threshold> <maxiterations> <center_real> <center_imaginary> <initialscale> <finalscale> <framecount> <resolution> <output_folder> <colorfile> [options]\n", argv[0]);
   printf("    This program simulates the Mandelbrot Fractal, and creates an iteration map of the given center, scale, and resolution, then saves it in output_file\n");
+  printf("    Options:\n");
+  printf("      --kernel <auto|scalar|avx2|avx512>   row kernel used for the calculation (default auto)\n");
+  printf("      --interior <off|bulbs|cycles|all>    exact shortcuts for points inside the set (default off)\n");
+  printf("      --precision <double|float|auto>      arithmetic of the row kernel: only double is exact; auto renders shallow frames in float\n");
+  printf("                                           and moves to double as the zoom deepens (default double)\n");
+  printf("      --subdivide                          skip uniform regions by Mariani-Silver subdivision; faster but not exact\n");
+  printf("      --threads <N>                        number of threads rendering the tiles of one frame (default 1)\n");
+  printf("      --render-threads <N>                 number of frames rendered at the same time (default 1)\n");
+  printf("      --color-threads <N>                  number of threads turning iteration maps into colors (default 1)\n");
+  printf("      --write-threads <N>                  number of threads writing .ppm files (default 1)\n");
+  printf("      --window <N>                         most frames held in memory at once (default: one per render, color and write thread)\n");
+  printf("                                           1 renders, colors and writes each frame on this thread before starting the next\n");
+  printf("      --split                              render iteration maps and color them in a separate pass (always the case with --subdivide)\n");
+  printf("      --perturbation                       render by perturbation around one high-precision orbit at the center, shared by all frames\n");
+  printf("      --series                             with --perturbation, skip early iterations by series approximation\n");
+  printf("      --stream <file|->                    write the whole movie as one stream to file, or to stdout for -, instead of .ppm files in output_folder\n");
+  printf("      --stream-format <y4m|rgb>            YUV4MPEG2 (4:4:4) or headerless rgb24 frames (default y4m)\n");
+  printf("      --fps <N>                            frame rate recorded in the y4m header (default 30)\n");
+  printf("      --cache <folder>                     keep every frame and its iteration map in folder, keyed by a hash of its parameters;\n");
+  printf("                                           a rerun copies the frames it finds there and recolors the maps it finds for a new palette\n");
+  printf("      --shard <i>/<N>                      render only frames i, i + N, i + 2N, ..., so N processes sharing output_folder make the whole movie\n");
+  printf("      --instrument <file>                  write per-frame and per-tile timings and iteration statistics to file as JSON lines\n");
+  printf("                                           (only in builds made with make INSTRUMENT=1)\n");
 }
 
+double MandelMovieScale(double initialscale, double finalscale, int framecount, int index);
+
+/*
+Called by MandelMovie once a frame is done. Returns 0 to continue, or nonzero to stop the movie.
+*/
+typedef int (*MandelMovieCallback)(void* arg, int index, IterationMap* frame);
 
 /*
 This function calculates the threshold values of every spot on a sequence of frames. The center stays the same throughout the zoom. First frame is at initialscale, and last frame is at finalscale scale.
 The remaining frames form a geometric sequence of scales, so 
 if initialscale=1024, finalscale=1, framecount=11, then your frames will have scales of 1024, 512, 256, 128, 64, 32, 16, 8, 4, 2, 1.
 As another example, if initialscale=10, finalscale=0.01, framecount=5, then your frames will have scale 10, 10 * (0.01/10)^(1/4), 10 * (0.01/10)^(2/4), 10 * (0.01/10)^(3/4), 0.01 .
+Frames are streamed: each one is rendered into frame, a map made for resolution and max_iterations, and handed to callback before the next one starts.
+Memory use is one frame no matter how long the movie is. Returns the first nonzero callback result, or 0.
 */
-void MandelMovie(double threshold, u_int64_t max_iterations, ComplexNumber* center, double initialscale, double finalscale, int framecount, u_int64_t resolution, u_int64_t ** output){
-    /* Output is given as an argument, so make sure to malloc the correct amount of space before inputting it into the function. Malloc only the 2d array, the 1d part is done below */
-    double counter = 0;
+int MandelMovie(const MandelbrotSettings* settings, double threshold, u_int64_t max_iterations, ComplexNumber* center, double initialscale, double finalscale, int framecount, u_int64_t resolution, IterationMap* frame, MandelMovieCallback callback, void* arg){
     double scale;
+    INSTRUMENT(InstrumentFrame stats);
     for (int index = 0; index < framecount; index += 1) {
-    	output[index] = malloc(sizeof(u_int64_t) * ((2 * resolution) + 1) * ((2 * resolution) + 1));
-    	scale = initialscale * (pow((finalscale/initialscale), (counter/(((double) framecount) - 1))));
-    	/* framecount cannot be 0 due to checking before it is inputted into this function. */
-    	Mandelbrot(threshold, max_iterations, center, scale, resolution, output[index]);
-    	counter += 1;
+    	scale = MandelMovieScale(initialscale, finalscale, framecount, index);
+    	INSTRUMENT(InstrumentFrameBegin(&stats, index, scale, max_iterations));
+    	INSTRUMENT(InstrumentTime start = InstrumentNow());
+    	MandelbrotRender(settings, threshold, max_iterations, center, scale, resolution, frame);
+    	INSTRUMENT(InstrumentStageEnd(&stats, INSTRUMENT_RENDER, start));
+    	int stop = callback(arg, index, frame);
+    	INSTRUMENT(InstrumentFrameEnd(&stats));
+    	if (stop) {
+    		return stop;
+    	}
     }
+    return 0;
+}
+
+/*
+Returns the scale of frame number index in the sequence described above.
+framecount cannot be 0 due to checking before it is inputted into this function.
+*/
+double MandelMovieScale(double initialscale, double finalscale, int framecount, int index)
+{
+	double counter = index;
+	return initialscale * (pow((finalscale/initialscale), (counter/(((double) framecount) - 1))));
+}
+
+/*
+Converts the iteration counts of one frame into P6 pixels, 3 bytes per pixel.
+Points that never escaped are black; the others cycle through the palette (see PaletteTable).
+*/
+void ColorizeFrame(IterationMap* iterations, const PaletteTable* palette, uint8_t* outputList)
+{
+	PaletteColorizeMap(palette, iterations, outputList);
+}
+
+//Writes the P6 pixels of frame frameNumber to output_folder/frameNNNNN.ppm. Returns 0 on success and 1 on failure.
+int WriteFrame(char* output_folder, int frameNumber, u_int64_t resolution, uint8_t* outputList)
+{
+	u_int64_t size = 2 * resolution + 1;
+	char* fileName = (char*) malloc((sizeof(char)) * (16 + (strlen(output_folder))));
+	if (fileName == NULL) {
+		return 1;
+	}
+	sprintf(fileName, "%s/frame%05d.ppm", output_folder, frameNumber);
+	int failed = WritePPM(fileName, PPM_P6, size, size, outputList);
+	if (failed) {
+		printf("Unable to write %s\n", fileName);
+	}
+	free(fileName);
+	return failed;
+}
+
+/*
+The movie is produced by three stages that run at the same time:
+render threads compute iteration maps, color threads turn them into pixels, and write threads store the .ppm files.
+In the fused mode render threads write pixels straight away (MandelbrotRenderRGB), no iteration maps exist,
+and frames go from the render stage directly to the write stage.
+Stages hand frames to each other through bounded queues, so disk writes and colorization overlap with rendering.
+The frame buffers come from a fixed window that is allocated once: a render thread waits for a writer to hand
+a frame back before it starts the next one, so peak memory is window frames however long the movie is.
+*/
+typedef struct MovieFrame
+{
+	int number;
+	IterationMap* iterations;
+	uint8_t* pixels;
+#ifdef MANDEL_INSTRUMENT
+	InstrumentFrame stats;
+#endif
+} MovieFrame;
+
+typedef struct MoviePipeline
+{
+	MandelContext* context;
+	MandelView view;     //Every frame's view, apart from the scale
+	ComplexNumber* center;
+	double initialscale;
+	double finalscale;
+	int framecount;
+	int shard;           //The pipeline renders frames shard, shard + shards, shard + 2 * shards, ...
+	int shards;
+	const MandelbrotSettings* settings; //As prepared by the context for view
+	const PaletteTable* palette;
+	char* output_folder;
+	VideoStream* stream; //When not NULL, frames go to this stream in order instead of to output_folder
+	FrameCache* cache;   //When not NULL, frames are looked up here before they are rendered, and stored here after
+	int fused;
+
+	MovieFrame* frames;
+	int window;
+	BoundedQueue* available;
+	BoundedQueue* rendered;
+	BoundedQueue* colored;
+	pthread_mutex_t lock;
+	int nextFrame;
+	int nextWrite;    //With a stream, the number of the next frame the write stage may output
+	MovieFrame** pending; //With a stream, frames that arrived before their turn, at number % window
+	int failed;
+} MoviePipeline;
+
+//Returns the view of frame frameNumber
+static MandelView frameView(const MoviePipeline* pipeline, int frameNumber)
+{
+	MandelView view = pipeline->view;
+	view.scale = MandelMovieScale(pipeline->initialscale, pipeline->finalscale, pipeline->framecount, frameNumber);
+	return view;
+}
+
+/*
+Writes the pixels of frame frameNumber to the pipeline's stream, or to its output folder and its cache.
+Returns 0 on success and 1 on failure.
+*/
+static int outputFrame(MoviePipeline* pipeline, int frameNumber, uint8_t* pixels)
+{
+	if (pipeline->stream == NULL) {
+		if (WriteFrame(pipeline->output_folder, frameNumber, pipeline->view.resolution, pixels)) {
+			return 1;
+		}
+		MandelView view = frameView(pipeline, frameNumber);
+		if (pipeline->cache != NULL && FrameCacheStoreFrame(pipeline->cache, &view, pixels)) {
+			printf("Unable to store frame %d in the cache\n", frameNumber);
+			return 1;
+		}
+		return 0;
+	}
+	if (VideoStreamWriteFrame(pipeline->stream, pixels)) {
+		printf("Unable to write frame %d to the stream\n", frameNumber);
+		return 1;
+	}
+	return 0;
+}
+
+//Where frameFromCache found a frame
+#define MOVIE_FRAME_RENDER 0    //Nowhere: it has to be rendered
+#define MOVIE_FRAME_COPIED 1    //Finished, and copied to the output folder
+#define MOVIE_FRAME_RECOLORED 2 //As an iteration map, which was colored into pixels
+
+//Looks frame frameNumber up in the pipeline's cache, and returns one of the MOVIE_FRAME_* values
+static int frameFromCache(MoviePipeline* pipeline, int frameNumber, const MandelView* view, uint8_t* pixels)
+{
+	if (pipeline->cache == NULL) {
+		return MOVIE_FRAME_RENDER;
+	}
+	/* "/frame", up to 10 digits, ".ppm" and the terminator */
+	char* fileName = (char*) malloc((sizeof(char)) * (21 + (strlen(pipeline->output_folder))));
+	if (fileName == NULL) {
+		return MOVIE_FRAME_RENDER;
+	}
+	sprintf(fileName, "%s/frame%05d.ppm", pipeline->output_folder, frameNumber);
+	int copied = FrameCacheLoadFrame(pipeline->cache, view, fileName) == 0;
+	free(fileName);
+	if (copied) {
+		return MOVIE_FRAME_COPIED;
+	}
+	IterationFile* map = FrameCacheOpenMap(pipeline->cache, view);
+	if (map == NULL) {
+		return MOVIE_FRAME_RENDER;
+	}
+	ColorizeFrame(&map->map, pipeline->palette, pixels);
+	closeIterationFile(map);
+	return MOVIE_FRAME_RECOLORED;
+}
+
+//Renders the iteration map of view into map, and stores it in the pipeline's cache. Returns 0 on success and 1 on failure.
+static int renderFrameMap(MoviePipeline* pipeline, const MandelView* view, IterationMap* map)
+{
+	if (MandelRenderMap(pipeline->context, view, map)) {
+		return 1;
+	}
+	if (pipeline->cache != NULL && FrameCacheStoreMap(pipeline->cache, view, map)) {
+		printf("Unable to store an iteration map in the cache\n");
+		return 1;
+	}
+	return 0;
+}
+
+//Allocates the window of frame buffers. Returns 0 on success and 1 on failure.
+static int allocateFrames(MoviePipeline* pipeline)
+{
+	u_int64_t size = 2 * pipeline->view.resolution + 1;
+	pipeline->frames = (MovieFrame*) calloc(pipeline->window, sizeof(MovieFrame));
+	if (pipeline->frames == NULL) {
+		return 1;
+	}
+	for (int i = 0; i < pipeline->window; i++) {
+		if (!pipeline->fused) {
+			pipeline->frames[i].iterations = newIterationMap(pipeline->view.resolution, pipeline->view.max_iterations);
+		}
+		pipeline->frames[i].pixels = (uint8_t*) malloc(3 * size * size * sizeof(uint8_t));
+		if ((!pipeline->fused && pipeline->frames[i].iterations == NULL) || pipeline->frames[i].pixels == NULL) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void freeFrames(MoviePipeline* pipeline)
+{
+	if (pipeline->frames == NULL) {
+		return;
+	}
+	for (int i = 0; i < pipeline->window; i++) {
+		freeIterationMap(pipeline->frames[i].iterations);
+		free(pipeline->frames[i].pixels);
+	}
+	free(pipeline->frames);
+}
+
+static void pipelineFail(MoviePipeline* pipeline)
+{
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->failed = 1;
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+//Returns the next frame number to render, or -1 when every frame has been handed out or something failed
+static int pipelineNextFrame(MoviePipeline* pipeline)
+{
+	int number = -1;
+	pthread_mutex_lock(&pipeline->lock);
+	if (!pipeline->failed && pipeline->nextFrame < pipeline->framecount) {
+		number = pipeline->nextFrame;
+		pipeline->nextFrame += pipeline->shards;
+	}
+	pthread_mutex_unlock(&pipeline->lock);
+	return number;
+}
+
+static void* renderStage(void* arg)
+{
+	MoviePipeline* pipeline = (MoviePipeline*) arg;
+	/* a frame buffer is taken before a frame number, so the lowest numbers handed out always have a buffer to render into */
+	MovieFrame* frame;
+	while ((frame = (MovieFrame*) BoundedQueuePop(pipeline->available)) != NULL) {
+		int number = pipelineNextFrame(pipeline);
+		if (number < 0) {
+			BoundedQueuePush(pipeline->available, frame);
+			break;
+		}
+		frame->number = number;
+		MandelView view = frameView(pipeline, number);
+		INSTRUMENT(InstrumentFrameBegin(&frame->stats, number, view.scale, view.max_iterations));
+		INSTRUMENT(InstrumentTime start = InstrumentNow());
+		int source = frameFromCache(pipeline, number, &view, frame->pixels);
+		if (source == MOVIE_FRAME_COPIED) {
+			BoundedQueuePush(pipeline->available, frame);
+			continue;
+		}
+		if (source == MOVIE_FRAME_RECOLORED) {
+			INSTRUMENT(InstrumentStageEnd(&frame->stats, INSTRUMENT_COLORIZE, start));
+			BoundedQueuePush(pipeline->colored, frame);
+			continue;
+		}
+		if (pipeline->fused) {
+			if (MandelRenderFrame(pipeline->context, &view, frame->pixels)) {
+				pipelineFail(pipeline);
+			}
+			INSTRUMENT(InstrumentStageEnd(&frame->stats, INSTRUMENT_RENDER, start));
+			BoundedQueuePush(pipeline->colored, frame);
+			continue;
+		}
+		if (renderFrameMap(pipeline, &view, frame->iterations)) {
+			pipelineFail(pipeline);
+		}
+		INSTRUMENT(InstrumentStageEnd(&frame->stats, INSTRUMENT_RENDER, start));
+		BoundedQueuePush(pipeline->rendered, frame);
+	}
+	return NULL;
+}
+
+static void* colorStage(void* arg)
+{
+	MoviePipeline* pipeline = (MoviePipeline*) arg;
+	MovieFrame* frame;
+	while ((frame = (MovieFrame*) BoundedQueuePop(pipeline->rendered)) != NULL) {
+		INSTRUMENT(InstrumentTime start = InstrumentNow());
+		ColorizeFrame(frame->iterations, pipeline->palette, frame->pixels);
+		INSTRUMENT(InstrumentStageEnd(&frame->stats, INSTRUMENT_COLORIZE, start));
+		BoundedQueuePush(pipeline->colored, frame);
+	}
+	return NULL;
+}
+
+static void* writeStage(void* arg)
+{
+	MoviePipeline* pipeline = (MoviePipeline*) arg;
+	MovieFrame* frame;
+	while ((frame = (MovieFrame*) BoundedQueuePop(pipeline->colored)) != NULL) {
+		INSTRUMENT(InstrumentTime start = InstrumentNow());
+		if (outputFrame(pipeline, frame->number, frame->pixels)) {
+			pipelineFail(pipeline);
+		}
+		INSTRUMENT(InstrumentStageEnd(&frame->stats, INSTRUMENT_WRITE, start));
+		INSTRUMENT(InstrumentFrameEnd(&frame->stats));
+		BoundedQueuePush(pipeline->available, frame);
+	}
+	return NULL;
+}
+
+/*
+The write stage for a stream, which has exactly one thread: frames can finish out of order, so each one waits in
+pending until every frame before it has been written. Fewer than window frames are ever in flight, so number % window
+never collides.
+*/
+static void* streamStage(void* arg)
+{
+	MoviePipeline* pipeline = (MoviePipeline*) arg;
+	MovieFrame* frame;
+	while ((frame = (MovieFrame*) BoundedQueuePop(pipeline->colored)) != NULL) {
+		pipeline->pending[frame->number % pipeline->window] = frame;
+		while ((frame = pipeline->pending[pipeline->nextWrite % pipeline->window]) != NULL && frame->number == pipeline->nextWrite) {
+			pipeline->pending[pipeline->nextWrite % pipeline->window] = NULL;
+			INSTRUMENT(InstrumentTime start = InstrumentNow());
+			if (outputFrame(pipeline, frame->number, frame->pixels)) {
+				pipelineFail(pipeline);
+			}
+			INSTRUMENT(InstrumentStageEnd(&frame->stats, INSTRUMENT_WRITE, start));
+			INSTRUMENT(InstrumentFrameEnd(&frame->stats));
+			pipeline->nextWrite += 1;
+			BoundedQueuePush(pipeline->available, frame);
+		}
+	}
+	return NULL;
+}
+
+//Starts count threads running function, and returns how many of them actually started
+static int startStage(pthread_t* threads, int count, void* (*function)(void*), MoviePipeline* pipeline)
+{
+	for (int i = 0; i < count; i++) {
+		if (pthread_create(&threads[i], NULL, function, pipeline) != 0) {
+			printf("Unable to start %d threads\n", count);
+			pipelineFail(pipeline);
+			return i;
+		}
+	}
+	return count;
+}
+
+static void joinStage(pthread_t* threads, int count)
+{
+	for (int i = 0; i < count; i++) {
+		pthread_join(threads[i], NULL);
+	}
+}
+
+/*
+Runs the render, color and write stages with the given number of threads each, and returns once every frame is on disk.
+The fused mode has no color stage, so colorThreads is ignored.
+Returns 0 on success and 1 if any frame could not be produced.
+*/
+int RunMoviePipeline(MoviePipeline* pipeline, int renderThreads, int colorThreads, int writeThreads)
+{
+	if (pipeline->fused) {
+		colorThreads = 0;
+	}
+	if (pipeline->stream != NULL) {
+		writeThreads = 1;
+	}
+	pipeline->pending = (MovieFrame**) calloc(pipeline->window, sizeof(MovieFrame*));
+	pthread_t* threads = (pthread_t*) malloc((renderThreads + colorThreads + writeThreads) * sizeof(pthread_t));
+	/* only window frames exist, so no queue ever has to hold more than that */
+	pipeline->available = newBoundedQueue(pipeline->window);
+	pipeline->rendered = newBoundedQueue(pipeline->window);
+	pipeline->colored = newBoundedQueue(pipeline->window);
+	if (threads == NULL || pipeline->pending == NULL || pipeline->available == NULL || pipeline->rendered == NULL || pipeline->colored == NULL || allocateFrames(pipeline)) {
+		printf("memory allocation problems");
+		free(threads);
+		free(pipeline->pending);
+		freeFrames(pipeline);
+		freeBoundedQueue(pipeline->available);
+		freeBoundedQueue(pipeline->rendered);
+		freeBoundedQueue(pipeline->colored);
+		return 1;
+	}
+	for (int i = 0; i < pipeline->window; i++) {
+		BoundedQueuePush(pipeline->available, &pipeline->frames[i]);
+	}
+	pthread_mutex_init(&pipeline->lock, NULL);
+	pipeline->nextFrame = pipeline->shard;
+	pipeline->nextWrite = 0;
+	pipeline->failed = 0;
+
+	pthread_t* renderers = threads;
+	pthread_t* colorers = threads + renderThreads;
+	pthread_t* writers = threads + renderThreads + colorThreads;
+	int writing = startStage(writers, writeThreads, pipeline->stream != NULL ? streamStage : writeStage, pipeline);
+	int coloring = startStage(colorers, colorThreads, colorStage, pipeline);
+	int rendering = startStage(renderers, renderThreads, renderStage, pipeline);
+	/* a stage ends when all of its producers are done and its queue is drained */
+	joinStage(renderers, rendering);
+	BoundedQueueClose(pipeline->rendered);
+	joinStage(colorers, coloring);
+	BoundedQueueClose(pipeline->colored);
+	joinStage(writers, writing);
+
+	int failed = pipeline->failed || writing == 0 || coloring < colorThreads || rendering == 0;
+	pthread_mutex_destroy(&pipeline->lock);
+	freeFrames(pipeline);
+	freeBoundedQueue(pipeline->available);
+	freeBoundedQueue(pipeline->rendered);
+	freeBoundedQueue(pipeline->colored);
+	free(pipeline->pending);
+	free(threads);
+	return failed;
+}
+
+//MandelMovie callback for RunMovieStream: colors and writes the frame right away
+static int streamFrame(void* arg, int index, IterationMap* frame)
+{
+	MoviePipeline* pipeline = (MoviePipeline*) arg;
+	/* MandelMovie made the frame it records this thread's current one */
+	INSTRUMENT(InstrumentFrame* stats = InstrumentCurrentFrame());
+	INSTRUMENT(InstrumentTime start = InstrumentNow());
+	ColorizeFrame(frame, pipeline->palette, pipeline->frames[0].pixels);
+	INSTRUMENT(InstrumentStageEnd(stats, INSTRUMENT_COLORIZE, start));
+	INSTRUMENT(start = InstrumentNow());
+	int failed = outputFrame(pipeline, index, pipeline->frames[0].pixels);
+	INSTRUMENT(InstrumentStageEnd(stats, INSTRUMENT_WRITE, start));
+	return failed;
+}
 
+/*
+Produces the movie on the calling thread, one frame at a time, with a single frame buffer.
+Returns 0 on success and 1 if any frame could not be produced.
+*/
+int RunMovieStream(MoviePipeline* pipeline)
+{
+	pipeline->window = 1;
+	if (allocateFrames(pipeline)) {
+		printf("memory allocation problems");
+		freeFrames(pipeline);
+		return 1;
+	}
+	int failed = 0;
+	if (pipeline->fused) {
+		for (int index = pipeline->shard; index < pipeline->framecount && !failed; index += pipeline->shards) {
+			MandelView view = pipeline->view;
+			view.scale = MandelMovieScale(pipeline->initialscale, pipeline->finalscale, pipeline->framecount, index);
+			INSTRUMENT(InstrumentFrameBegin(&pipeline->frames[0].stats, index, view.scale, view.max_iterations));
+			INSTRUMENT(InstrumentTime start = InstrumentNow());
+			failed = MandelRenderFrame(pipeline->context, &view, pipeline->frames[0].pixels);
+			INSTRUMENT(InstrumentStageEnd(&pipeline->frames[0].stats, INSTRUMENT_RENDER, start));
+			INSTRUMENT(start = InstrumentNow());
+			failed = failed || outputFrame(pipeline, index, pipeline->frames[0].pixels);
+			INSTRUMENT(InstrumentStageEnd(&pipeline->frames[0].stats, INSTRUMENT_WRITE, start));
+			INSTRUMENT(InstrumentFrameEnd(&pipeline->frames[0].stats));
+		}
+	}
+	else if (pipeline->shards > 1 || pipeline->cache != NULL) {
+		/* MandelMovie renders every frame, so a shard, or a movie partly in the cache, goes through its own frames here */
+		for (int index = pipeline->shard; index < pipeline->framecount && !failed; index += pipeline->shards) {
+			MandelView view = frameView(pipeline, index);
+			INSTRUMENT(InstrumentFrameBegin(&pipeline->frames[0].stats, index, view.scale, view.max_iterations));
+			int source = frameFromCache(pipeline, index, &view, pipeline->frames[0].pixels);
+			if (source == MOVIE_FRAME_RECOLORED) {
+				failed = outputFrame(pipeline, index, pipeline->frames[0].pixels);
+			}
+			else if (source == MOVIE_FRAME_RENDER) {
+				INSTRUMENT(InstrumentTime start = InstrumentNow());
+				failed = renderFrameMap(pipeline, &view, pipeline->frames[0].iterations);
+				INSTRUMENT(InstrumentStageEnd(&pipeline->frames[0].stats, INSTRUMENT_RENDER, start));
+				failed = failed || streamFrame(pipeline, index, pipeline->frames[0].iterations);
+			}
+			INSTRUMENT(InstrumentFrameEnd(&pipeline->frames[0].stats));
+		}
+	}
+	else {
+		failed = MandelMovie(pipeline->settings, pipeline->view.threshold, pipeline->view.max_iterations, pipeline->center,
+			pipeline->initialscale, pipeline->finalscale, pipeline->framecount, pipeline->view.resolution,
+			pipeline->frames[0].iterations, streamFrame, pipeline);
+	}
+	freeFrames(pipeline);
+	return failed != 0;
 }
 
 /**************
@@ -58,11 +562,161 @@ int main(int argc, char* argv[])
 	Remember to use your solution to B.1.1 to process colorfile.
 	*/
 
-	if (argc != 11) {
+	if (argc < 11) {
 		printf("%s: Wrong number of arguments, expecting 10\n", argv[0]);
 		printUsage(argv);
 		return 1;
 	}
+	MandelbrotSettings settings;
+	MandelbrotDefaultSettings(&settings);
+	int threads = 1;
+	int renderThreads = 1;
+	int colorThreads = 1;
+	int writeThreads = 1;
+	int window = 0;
+	int perturbation = 0;
+	int split = 0;
+	char* streamfile = NULL;
+	char* cachefolder = NULL;
+	u_int64_t shard = 0;
+	u_int64_t shards = 1;
+	int streamformat = VIDEO_STREAM_Y4M;
+	int fps = 30;
+	char* instrumentfile = NULL;
+	for (int i = 11; i < argc; i++) {
+		if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+			settings.rowKernel = MandelbrotRowKernelNamed(argv[++i]);
+			if (settings.rowKernel == NULL) {
+				printf("%s: Kernel %s is unknown or not supported by this CPU\n", argv[0], argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--interior") == 0 && i + 1 < argc) {
+			settings.interior = MandelbrotInteriorNamed(argv[++i]);
+			if (settings.interior < 0) {
+				printf("%s: Unknown interior shortcut %s\n", argv[0], argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+			settings.precision = MandelbrotPrecisionNamed(argv[++i]);
+			if (settings.precision < 0) {
+				printf("%s: Unknown precision %s\n", argv[0], argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--subdivide") == 0) {
+			settings.subdivide = 1;
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+			if (threads < 1) {
+				printf("%s: The number of threads must be > 0\n", argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--render-threads") == 0 && i + 1 < argc) {
+			renderThreads = atoi(argv[++i]);
+			if (renderThreads < 1) {
+				printf("%s: The number of render threads must be > 0\n", argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--color-threads") == 0 && i + 1 < argc) {
+			colorThreads = atoi(argv[++i]);
+			if (colorThreads < 1) {
+				printf("%s: The number of color threads must be > 0\n", argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+			window = atoi(argv[++i]);
+			if (window < 1) {
+				printf("%s: The window must hold at least 1 frame\n", argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--write-threads") == 0 && i + 1 < argc) {
+			writeThreads = atoi(argv[++i]);
+			if (writeThreads < 1) {
+				printf("%s: The number of write threads must be > 0\n", argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--split") == 0) {
+			split = 1;
+		}
+		else if (strcmp(argv[i], "--perturbation") == 0) {
+			perturbation = 1;
+		}
+		else if (strcmp(argv[i], "--series") == 0) {
+			settings.series = 1;
+		}
+		else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+			streamfile = argv[++i];
+		}
+		else if (strcmp(argv[i], "--stream-format") == 0 && i + 1 < argc) {
+			streamformat = VideoStreamFormatNamed(argv[++i]);
+			if (streamformat < 0) {
+				printf("%s: Unknown stream format %s\n", argv[0], argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			fps = atoi(argv[++i]);
+			if (fps < 1) {
+				printf("%s: The frame rate must be > 0\n", argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+			cachefolder = argv[++i];
+		}
+		else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+			/* there are never more than 10000 frames to go around */
+			if (ParseShard(argv[++i], &shard, &shards)) {
+				printf("%s: Expected --shard <i>/<N> with 0 <= i < N <= %d, not %s\n", argv[0], SHARD_MAX, argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--instrument") == 0 && i + 1 < argc) {
+			instrumentfile = argv[++i];
+		}
+		else {
+			printf("%s: Unknown option %s\n", argv[0], argv[i]);
+			printUsage(argv);
+			return 1;
+		}
+	}
+	if (cachefolder != NULL && streamfile != NULL) {
+		printf("%s: --cache works with .ppm files; a stream is always written from its first frame\n", argv[0]);
+		return 1;
+	}
+	if (shards > 1 && streamfile != NULL) {
+		printf("%s: --shard writes .ppm files; a stream needs every frame from one process\n", argv[0]);
+		return 1;
+	}
+#ifdef MANDEL_INSTRUMENT
+	if (instrumentfile != NULL && InstrumentOpen(instrumentfile)) {
+		printf("Unable to write %s\n", instrumentfile);
+		return 1;
+	}
+#else
+	if (instrumentfile != NULL) {
+		printf("%s: --instrument needs a build with instrumentation (make clean; make INSTRUMENT=1)\n", argv[0]);
+		return 1;
+	}
+#endif
+	/* a movie streamed to stdout keeps the original stdout for itself, and every message goes to stderr instead */
+	int streamfd = -1;
+	if (streamfile != NULL && strcmp(streamfile, "-") == 0) {
+		fflush(stdout);
+		streamfd = dup(STDOUT_FILENO);
+		if (streamfd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+			printf("Unable to write the stream to stdout\n");
+			return 1;
+		}
+	}
 	double threshold, initialscale, finalscale;
 	int framecount;
 	ComplexNumber* center;
@@ -92,93 +746,88 @@ int main(int argc, char* argv[])
 
 	//STEP 2: Run MandelMovie on the correct arguments.
 	/*
-	MandelMovie requires an output array, so make sure you allocate the proper amount of space. 
+	Frames are not rendered up front: the pipeline in STEP 3 renders, colors and writes them as it goes,
+	through a render context that is set up once for all of them.
 	If allocation fails, free all the space you have already allocated (including colormap), then return with exit code 1.
 	*/
 
-	int* colorcount = malloc(sizeof(int));
-	if (colorcount == NULL) {
-		printf("memory allocation problems");
-		free(colorcount);
+	/* the context keeps the pool, the palette table and the reference orbit that every frame shares */
+	MandelContext* context = newMandelContext(&settings, threads);
+	if (context == NULL) {
+		printf("Unable to start %d threads\n", threads);
+		freeComplexNumber(center);
 		return 1;
 	}
-	uint8_t** colorMap = FileToColorMap(colorfile, colorcount);
-
-	u_int64_t** output = (u_int64_t**) malloc(framecount * sizeof(u_int64_t*));
-
-	if (output == NULL) {
-		printf("memory allocation problems");
-		freeDoublePointer(colorMap);
-		free(output);
-		free(colorcount);
+	if (MandelContextLoadPalette(context, colorfile)) {
+		freeMandelContext(context);
+		freeComplexNumber(center);
+		return 1;
+	}
+	MandelContextSetPerturbation(context, perturbation);
+	MandelView view = {threshold, max_iterations, Re(center), Im(center), initialscale, resolution};
+	const MandelbrotSettings* prepared = MandelContextPrepare(context, &view);
+	if (prepared == NULL) {
+		printf(perturbation ? "Unable to allocate the reference orbit\n" : "memory allocation problems");
+		freeMandelContext(context);
+		freeComplexNumber(center);
 		return 1;
 	}
 
-	MandelMovie(threshold, max_iterations, center, initialscale, finalscale, framecount, resolution, output);
+	/* the cache needs iteration maps to store, so it never uses the fused mode */
+	FrameCache* cache = NULL;
+	if (cachefolder != NULL) {
+		cache = newFrameCache(cachefolder, prepared, MandelContextPalette(context)->palette);
+		if (cache == NULL) {
+			printf("Unable to use %s as a cache\n", cachefolder);
+			freeMandelContext(context);
+			freeComplexNumber(center);
+			return 1;
+		}
+	}
 
+	VideoStream* stream = NULL;
+	if (streamfile != NULL) {
+		u_int64_t size = 2 * resolution + 1;
+		stream = newVideoStream(streamfd >= 0 ? NULL : streamfile, streamfd, streamformat, size, size, fps);
+		if (stream == NULL) {
+			printf("Unable to write %s\n", streamfile);
+			freeMandelContext(context);
+			freeComplexNumber(center);
+			return 1;
+		}
+	}
 
-	//STEP 3: Output the results of MandelMovie to .ppm files.
+
+	//STEP 3: Output the results of MandelMovie to .ppm files, or to one video stream with --stream.
 	/*
 	Convert from iteration count to colors, and output the results into output files.
-	Use what we showed you in Part B.1.2, create a seqeunce of ppm files in the output folder.
-	Feel free to create your own helper function to complete this step.
+	Each frame goes through the render, color and write stages of the pipeline, which all run at the same time,
+	or, with a window of one frame, is rendered, colored and written on this thread before the next one starts.
 	As a reminder, we are using P6 format, not P3.
 	*/
-
-
-
-
-	uint8_t* color;
-	int frameNumber = 0;
-	int indexer;
-
-
-
-
-	for (int i = 0; i < framecount; i++) {
-		char* fileName = (char*) malloc((sizeof(char)) * (16 + (strlen(output_folder))));
-		sprintf(fileName, "%s/frame%05d.ppm", output_folder, frameNumber);
-		frameNumber += 1;
-		FILE* fileptr = fopen(fileName, "w");
-		fprintf(fileptr, "P6 %lu %lu 255\n", ((2 * resolution) + 1), ((2 * resolution) + 1)); 
-		uint8_t* outputList = (uint8_t*) malloc(3 * ((2*resolution)+1) * ((2*resolution)+1) * sizeof(uint8_t));
-		int index = 0;
-		if (outputList == NULL) {
-			free(outputList);
-			fclose(fileptr);
-			free(fileName);
-			return 1;
-		}
-
-		for (int y = 0; y < ((2 * resolution + 1) * (2 * resolution + 1)); y++) {
-					if (output[i][y] == 0) {
-						outputList[index] = (uint8_t) 0;
-						index += 1;
-						outputList[index] = (uint8_t) 0;
-						index += 1;
-						outputList[index] = (uint8_t) 0;
-						index += 1;
-					} else {
-						/* Pretty sure modulus has to be between two ints, so cast if needed. */
-						indexer = (((output[i][y]) % *colorcount) - 1) % *colorcount;
-						color = colorMap[indexer];
-						outputList[index] = (uint8_t) color[0];
-						index += 1;
-						outputList[index] = (uint8_t) color[1];
-						index += 1;
-						outputList[index] = (uint8_t) color[2];
-						index += 1;
-					}
-
-		}
-		/*
-		for (int j = 0; j < 3 * ((2*resolution)+1) * ((2*resolution)+1); j++) {
-			fprintf(fileptr, "ActualColorNumber: %d\n", outputList[j]);
-		} */
-		fwrite(outputList, sizeof(uint8_t), (3 * (2 * resolution + 1) * (2 * resolution + 1)), fileptr);
-		free(fileName);
-		fclose(fileptr);
-		free(outputList);
+	MoviePipeline pipeline;
+	pipeline.context = context;
+	pipeline.view = view;
+	pipeline.center = center;
+	pipeline.initialscale = initialscale;
+	pipeline.finalscale = finalscale;
+	pipeline.framecount = framecount;
+	pipeline.shard = (int) shard;
+	pipeline.shards = (int) shards;
+	pipeline.settings = prepared;
+	pipeline.palette = MandelContextPalette(context);
+	pipeline.fused = !split && !settings.subdivide && cache == NULL;
+	pipeline.output_folder = output_folder;
+	pipeline.stream = stream;
+	pipeline.cache = cache;
+	pipeline.frames = NULL;
+	pipeline.window = window > 0 ? window : renderThreads + colorThreads + writeThreads;
+	int failed;
+	if (pipeline.window == 1) {
+		failed = RunMovieStream(&pipeline);
+	}
+	else {
+		failed = RunMoviePipeline(&pipeline, renderThreads, colorThreads, writeThreads);
 	}
 
 
@@ -187,16 +836,24 @@ int main(int argc, char* argv[])
 	/*
 	Make sure there's no memory leak.
 	*/
-	freeComplexNumber(center);
-	freeDoublePointer(colorMap, colorcount);
-	free(colorcount);
-	for (int q = 0; q < framecount; q++) {
-		free(output[q]);
+	if (cache != NULL) {
+		FrameCacheStats stats;
+		FrameCacheGetStats(cache, &stats);
+		printf("\n%lu frames copied from the cache, %lu recolored from cached iteration maps, %lu rendered\n", stats.frames, stats.maps, stats.stored);
+		freeFrameCache(cache);
+	}
+	if (freeVideoStream(stream)) {
+		printf("Unable to write %s\n", streamfile);
+		failed = 1;
 	}
-	free(output);
+#ifdef MANDEL_INSTRUMENT
+	if (InstrumentClose()) {
+		printf("Unable to write %s\n", instrumentfile);
+		failed = 1;
+	}
+#endif
+	freeMandelContext(context);
+	freeComplexNumber(center);
 
-	return 0;
+	return failed;
 }
-
-
-
@@ -0,0 +1,551 @@
+/*********************
+**  Mandelbrot tile server
+**  Answers HTTP requests for map tiles on a loopback port or a Unix socket:
+**      GET /tile/<zoom>/<x>/<y>.ppm?threshold=2&max_iterations=1536&palette=default   a P6 image
+**      GET /tile/<zoom>/<x>/<y>.rgb?...                                               the same pixels, without the header
+**      GET /stats                                                                      cache counters as JSON
+**  At zoom z the square from -2-2i to 2+2i is cut into 2^z by 2^z tiles, x counting from the left and y from the top.
+**  Every tile is 2 * resolution + 1 pixels wide, centered on its square, so neighbours share their edge pixels.
+**  Rendered tiles are kept in a TileCache, and concurrent requests for one tile share a single render.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "MandelContext.h"
+#include "TileCache.h"
+
+void printUsage(char* argv[])
+{
+  printf("Usage: %s [options]\n", argv[0]);
+  printf("    Serves Mandelbrot tiles over HTTP until interrupted\n");
+  printf("    Options:\n");
+  printf("      --port <N>                 listen on 127.0.0.1:N (default 8061)\n");
+  printf("      --socket <path>            listen on a Unix socket instead\n");
+  printf("      --palette <name>=<file>    a palette requests can ask for by name; may be repeated (default: default=defaultcolormap.txt)\n");
+  printf("      --resolution <N>           tiles are 2N+1 pixels wide (default 128)\n");
+  printf("      --workers <N>              requests handled at the same time (default 4)\n");
+  printf("      --cache <MB>               memory for rendered tiles (default 256)\n");
+  printf("      --kernel <auto|scalar|avx2|avx512>   row kernel used for the calculation (default auto)\n");
+  printf("      --interior <off|bulbs|cycles|all>    exact shortcuts for points inside the set (default off)\n");
+}
+
+//Bits of precision in a double: a tile at zoom z has 2 * resolution pixels across 2^-z, so z + log2(2 * resolution) must stay within them
+#define SERVE_PRECISION_BITS 52
+//Largest max_iterations a request may ask for
+#define SERVE_MAX_ITERATIONS (1 << 20)
+//Longest request read
+#define SERVE_REQUEST_SIZE 8192
+#define SERVE_MAX_PALETTES 16
+//Seconds a client gets to send its whole request, and for each send of the answer, before the connection is closed
+#define SERVE_TIMEOUT 10
+
+typedef struct ServePalette
+{
+	char* name;
+	char* colorfile;
+} ServePalette;
+
+typedef struct Server
+{
+	int listener;
+	TileCache* cache;
+	u_int64_t resolution;
+	//Deepest zoom served, set from the resolution by serveMaxZoom
+	u_int64_t maxZoom;
+	MandelbrotSettings settings;
+	ServePalette palettes[SERVE_MAX_PALETTES];
+	int paletteCount;
+} Server;
+
+//One request handling thread, with a render context for every palette so that renders never share one
+typedef struct ServeWorker
+{
+	Server* server;
+	MandelContext* contexts[SERVE_MAX_PALETTES];
+	pthread_t thread;
+} ServeWorker;
+
+static volatile sig_atomic_t stopping = 0;
+static int stopListener = -1;
+
+//Wakes the workers out of accept, which is all a signal handler may safely do here
+static void stopServer(int signal)
+{
+	stopping = 1;
+	if (stopListener >= 0) {
+		shutdown(stopListener, SHUT_RDWR);
+	}
+}
+
+//TileRender for TileCacheAcquire: renders the tile of key in P6 pixel order
+static uint8_t* renderTile(void* arg, const TileKey* key, u_int64_t* length)
+{
+	ServeWorker* worker = (ServeWorker*) arg;
+	u_int64_t size = 2 * worker->server->resolution + 1;
+	double span = 4.0 / (double) ((u_int64_t) 1 << key->zoom);
+	MandelView view;
+	view.threshold = key->threshold;
+	view.max_iterations = key->max_iterations;
+	view.centerReal = -2 + span * (key->x + 0.5);
+	view.centerImaginary = 2 - span * (key->y + 0.5);
+	view.scale = span / 2;
+	view.resolution = worker->server->resolution;
+	uint8_t* pixels = (uint8_t*) malloc(3 * size * size);
+	if (pixels == NULL || MandelRenderFrame(worker->contexts[key->palette], &view, pixels)) {
+		free(pixels);
+		return NULL;
+	}
+	*length = 3 * size * size;
+	return pixels;
+}
+
+//Sends all length bytes of data. Returns 0 on success and 1 on failure.
+static int sendAll(int fd, const void* data, u_int64_t length)
+{
+	const char* bytes = (const char*) data;
+	while (length > 0) {
+		ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 1;
+		}
+		bytes += sent;
+		length -= sent;
+	}
+	return 0;
+}
+
+static void sendText(int fd, const char* status, const char* contentType, const char* body)
+{
+	char header[256];
+	int length = snprintf(header, sizeof(header), "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+		status, contentType, strlen(body));
+	if (sendAll(fd, header, length) == 0) {
+		sendAll(fd, body, strlen(body));
+	}
+}
+
+/*
+Reads the value of name from query ("a=1&b=2") into value, which holds size bytes.
+Returns 1 if name is there and 0 otherwise.
+*/
+static int queryValue(const char* query, const char* name, char* value, size_t size)
+{
+	size_t nameLength = strlen(name);
+	while (query != NULL && *query != '\0') {
+		const char* end = strchr(query, '&');
+		size_t length = end != NULL ? (size_t) (end - query) : strlen(query);
+		if (length > nameLength && strncmp(query, name, nameLength) == 0 && query[nameLength] == '=') {
+			size_t valueLength = length - nameLength - 1;
+			if (valueLength >= size) {
+				return 0;
+			}
+			memcpy(value, query + nameLength + 1, valueLength);
+			value[valueLength] = '\0';
+			return 1;
+		}
+		query = end != NULL ? end + 1 : NULL;
+	}
+	return 0;
+}
+
+/*
+Fills key and format (1 for .ppm, 0 for .rgb) from a tile path such as /tile/3/2/5.ppm?max_iterations=500.
+Returns NULL on success, or the reason the request is bad.
+*/
+//Returns the deepest zoom whose pixels are still distinct doubles, or -1 if the resolution leaves none
+static int serveMaxZoom(u_int64_t resolution)
+{
+	int bits = 0;
+	while (bits < SERVE_PRECISION_BITS && ((u_int64_t) 1 << bits) < 2 * resolution) {
+		bits++;
+	}
+	if (((u_int64_t) 1 << bits) < 2 * resolution) {
+		return -1;
+	}
+	return SERVE_PRECISION_BITS - bits;
+}
+
+static const char* parseTile(Server* server, char* path, TileKey* key, int* ppm)
+{
+	unsigned long zoom, x, y;
+	char extension[8];
+	int consumed = 0;
+	if (sscanf(path, "/tile/%lu/%lu/%lu.%3[a-z]%n", &zoom, &x, &y, extension, &consumed) != 4) {
+		return "Expected /tile/<zoom>/<x>/<y>.ppm or .rgb\n";
+	}
+	if (path[consumed] != '\0' && path[consumed] != '?') {
+		return "Expected /tile/<zoom>/<x>/<y>.ppm or .rgb\n";
+	}
+	const char* query = path[consumed] == '?' ? path + consumed + 1 : NULL;
+	if (strcmp(extension, "ppm") != 0 && strcmp(extension, "rgb") != 0) {
+		return "Tiles come as .ppm or .rgb\n";
+	}
+	if (zoom > server->maxZoom || x >= ((u_int64_t) 1 << zoom) || y >= ((u_int64_t) 1 << zoom)) {
+		return "No such tile\n";
+	}
+	memset(key, 0, sizeof(TileKey));
+	key->zoom = zoom;
+	key->x = x;
+	key->y = y;
+	key->threshold = 2;
+	key->max_iterations = 1536;
+	key->palette = 0;
+	char value[64];
+	if (queryValue(query, "threshold", value, sizeof(value))) {
+		key->threshold = atof(value);
+		if (!(key->threshold > 0)) {
+			return "The threshold must be > 0\n";
+		}
+	}
+	if (queryValue(query, "max_iterations", value, sizeof(value))) {
+		key->max_iterations = strtoull(value, NULL, 10);
+		if (key->max_iterations < 1 || key->max_iterations > SERVE_MAX_ITERATIONS) {
+			return "max_iterations is out of range\n";
+		}
+	}
+	if (queryValue(query, "palette", value, sizeof(value))) {
+		int found = 0;
+		for (int i = 0; i < server->paletteCount && !found; i++) {
+			if (strcmp(server->palettes[i].name, value) == 0) {
+				key->palette = i;
+				found = 1;
+			}
+		}
+		if (!found) {
+			return "Unknown palette\n";
+		}
+	}
+	*ppm = strcmp(extension, "ppm") == 0;
+	return NULL;
+}
+
+static void sendStats(Server* server, int fd)
+{
+	TileCacheStats stats;
+	TileCacheGetStats(server->cache, &stats);
+	char body[512];
+	snprintf(body, sizeof(body), "{\"hits\": %lu, \"misses\": %lu, \"coalesced\": %lu, \"evictions\": %lu, \"tiles\": %lu, \"bytes\": %lu, \"capacity\": %lu}\n",
+		stats.hits, stats.misses, stats.coalesced, stats.evictions, stats.tiles, stats.bytes, stats.capacity);
+	sendText(fd, "200 OK", "application/json", body);
+}
+
+//Milliseconds left until deadline, 0 once it has passed
+static int millisecondsUntil(const struct timespec* deadline)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long long left = (deadline->tv_sec - now.tv_sec) * 1000LL + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+	return left > 0 ? (int) left : 0;
+}
+
+/*
+Reads one request from fd and answers it.
+The whole request must arrive within SERVE_TIMEOUT seconds, so a client that connects and sends nothing, or trickles
+its request in, does not hold the worker; the connection is closed without an answer when the time is up.
+*/
+static void handleRequest(ServeWorker* worker, int fd)
+{
+	Server* server = worker->server;
+	char request[SERVE_REQUEST_SIZE];
+	size_t length = 0;
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += SERVE_TIMEOUT;
+	while (length < sizeof(request) - 1) {
+		struct pollfd readable = {fd, POLLIN, 0};
+		int ready = poll(&readable, 1, millisecondsUntil(&deadline));
+		if (ready < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ready <= 0) {
+			return;
+		}
+		ssize_t received = recv(fd, request + length, sizeof(request) - 1 - length, 0);
+		if (received < 0 && errno == EINTR) {
+			continue;
+		}
+		if (received <= 0) {
+			break;
+		}
+		length += received;
+		request[length] = '\0';
+		if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL) {
+			break;
+		}
+	}
+	request[length] = '\0';
+	char path[1024];
+	if (sscanf(request, "GET %1023s HTTP/", path) != 1) {
+		sendText(fd, "400 Bad Request", "text/plain", "Only GET requests are served\n");
+		return;
+	}
+	if (strcmp(path, "/stats") == 0) {
+		sendStats(server, fd);
+		return;
+	}
+	if (strncmp(path, "/tile/", 6) != 0) {
+		sendText(fd, "404 Not Found", "text/plain", "No such resource\n");
+		return;
+	}
+	TileKey key;
+	int ppm;
+	const char* error = parseTile(server, path, &key, &ppm);
+	if (error != NULL) {
+		sendText(fd, "400 Bad Request", "text/plain", error);
+		return;
+	}
+	int how;
+	Tile* tile = TileCacheAcquire(server->cache, &key, renderTile, worker, &how);
+	if (tile == NULL) {
+		sendText(fd, "500 Internal Server Error", "text/plain", "Unable to render the tile\n");
+		return;
+	}
+	static const char* cacheNames[] = {"hit", "miss", "coalesced"};
+	u_int64_t size = 2 * server->resolution + 1;
+	char body[64];
+	int bodyHeader = ppm ? snprintf(body, sizeof(body), "P6 %lu %lu 255\n", size, size) : 0;
+	char header[256];
+	int headerLength = snprintf(header, sizeof(header),
+		"HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %lu\r\nX-Cache: %s\r\nConnection: close\r\n\r\n",
+		ppm ? "image/x-portable-pixmap" : "application/octet-stream", bodyHeader + TileLength(tile), cacheNames[how]);
+	if (sendAll(fd, header, headerLength) == 0 && sendAll(fd, body, bodyHeader) == 0) {
+		sendAll(fd, TileData(tile), TileLength(tile));
+	}
+	TileCacheRelease(server->cache, tile);
+}
+
+static void* serveWorker(void* arg)
+{
+	ServeWorker* worker = (ServeWorker*) arg;
+	while (!stopping) {
+		int fd = accept(worker->server->listener, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			break;
+		}
+		/* a client that stops reading the answer fails the send instead of blocking the worker */
+		struct timeval timeout = {SERVE_TIMEOUT, 0};
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		handleRequest(worker, fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+//Opens the listening socket: a Unix socket at socketPath if it is not NULL, and 127.0.0.1:port otherwise. Returns -1 on failure.
+static int openListener(const char* socketPath, int port)
+{
+	int fd;
+	if (socketPath != NULL) {
+		struct sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (strlen(socketPath) >= sizeof(address.sun_path)) {
+			return -1;
+		}
+		strcpy(address.sun_path, socketPath);
+		unlink(socketPath);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0 || bind(fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+			if (fd >= 0) {
+				close(fd);
+			}
+			return -1;
+		}
+	}
+	else {
+		struct sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		int reuse = 1;
+		if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+			|| bind(fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+			if (fd >= 0) {
+				close(fd);
+			}
+			return -1;
+		}
+	}
+	if (listen(fd, 64) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void freeWorkers(ServeWorker* workers, int count, int paletteCount)
+{
+	for (int i = 0; i < count; i++) {
+		for (int p = 0; p < paletteCount; p++) {
+			freeMandelContext(workers[i].contexts[p]);
+		}
+	}
+	free(workers);
+}
+
+int main(int argc, char* argv[])
+{
+	Server server;
+	memset(&server, 0, sizeof(server));
+	MandelbrotDefaultSettings(&server.settings);
+	server.resolution = 128;
+	int port = 8061;
+	char* socketPath = NULL;
+	int workerCount = 4;
+	u_int64_t cacheMegabytes = 256;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+			port = atoi(argv[++i]);
+			if (port < 1 || port > 65535) {
+				printf("%s: Invalid port %s\n", argv[0], argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+			socketPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--palette") == 0 && i + 1 < argc) {
+			char* separator = strchr(argv[++i], '=');
+			if (separator == NULL || server.paletteCount == SERVE_MAX_PALETTES) {
+				printf("%s: Expected --palette <name>=<file>, at most %d times\n", argv[0], SERVE_MAX_PALETTES);
+				return 1;
+			}
+			*separator = '\0';
+			server.palettes[server.paletteCount].name = argv[i];
+			server.palettes[server.paletteCount].colorfile = separator + 1;
+			server.paletteCount += 1;
+		}
+		else if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+			int resolution = atoi(argv[++i]);
+			if (resolution < 1) {
+				printf("%s: The resolution must be > 0\n", argv[0]);
+				return 1;
+			}
+			server.resolution = (u_int64_t) resolution;
+		}
+		else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+			workerCount = atoi(argv[++i]);
+			if (workerCount < 1) {
+				printf("%s: The number of workers must be > 0\n", argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+			int megabytes = atoi(argv[++i]);
+			if (megabytes < 1) {
+				printf("%s: The cache size must be > 0\n", argv[0]);
+				return 1;
+			}
+			cacheMegabytes = (u_int64_t) megabytes;
+		}
+		else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+			server.settings.rowKernel = MandelbrotRowKernelNamed(argv[++i]);
+			if (server.settings.rowKernel == NULL) {
+				printf("%s: Kernel %s is unknown or not supported by this CPU\n", argv[0], argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--interior") == 0 && i + 1 < argc) {
+			server.settings.interior = MandelbrotInteriorNamed(argv[++i]);
+			if (server.settings.interior < 0) {
+				printf("%s: Unknown interior shortcut %s\n", argv[0], argv[i]);
+				return 1;
+			}
+		}
+		else {
+			printf("%s: Unknown option %s\n", argv[0], argv[i]);
+			printUsage(argv);
+			return 1;
+		}
+	}
+	int maxZoom = serveMaxZoom(server.resolution);
+	if (maxZoom < 0) {
+		printf("%s: The resolution must be at most %lu\n", argv[0], (u_int64_t) 1 << (SERVE_PRECISION_BITS - 1));
+		return 1;
+	}
+	server.maxZoom = (u_int64_t) maxZoom;
+	if (server.paletteCount == 0) {
+		server.palettes[0].name = "default";
+		server.palettes[0].colorfile = "defaultcolormap.txt";
+		server.paletteCount = 1;
+	}
+
+	ServeWorker* workers = (ServeWorker*) calloc(workerCount, sizeof(ServeWorker));
+	if (workers == NULL) {
+		printf("memory allocation problems");
+		return 1;
+	}
+	for (int i = 0; i < workerCount; i++) {
+		workers[i].server = &server;
+		for (int p = 0; p < server.paletteCount; p++) {
+			workers[i].contexts[p] = newMandelContext(&server.settings, 1);
+			if (workers[i].contexts[p] == NULL || MandelContextLoadPalette(workers[i].contexts[p], server.palettes[p].colorfile)) {
+				printf("\nUnable to load palette %s from %s\n", server.palettes[p].name, server.palettes[p].colorfile);
+				freeWorkers(workers, workerCount, server.paletteCount);
+				return 1;
+			}
+		}
+	}
+	server.cache = newTileCache(cacheMegabytes << 20);
+	server.listener = openListener(socketPath, port);
+	if (server.cache == NULL || server.listener < 0) {
+		printf("\nUnable to listen on %s\n", socketPath != NULL ? socketPath : "127.0.0.1");
+		freeTileCache(server.cache);
+		freeWorkers(workers, workerCount, server.paletteCount);
+		return 1;
+	}
+
+	stopListener = server.listener;
+	signal(SIGINT, stopServer);
+	signal(SIGTERM, stopServer);
+	signal(SIGPIPE, SIG_IGN);
+	if (socketPath != NULL) {
+		printf("\nServing %lu-pixel tiles up to zoom %lu on %s\n", 2 * server.resolution + 1, server.maxZoom, socketPath);
+	}
+	else {
+		printf("\nServing %lu-pixel tiles up to zoom %lu on http://127.0.0.1:%d/tile/<zoom>/<x>/<y>.ppm\n", 2 * server.resolution + 1, server.maxZoom, port);
+	}
+	fflush(stdout);
+	int started = 0;
+	while (started < workerCount && pthread_create(&workers[started].thread, NULL, serveWorker, &workers[started]) == 0) {
+		started++;
+	}
+	if (started < workerCount) {
+		printf("Unable to start %d workers\n", workerCount);
+		stopServer(0);
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	close(server.listener);
+	if (socketPath != NULL) {
+		unlink(socketPath);
+	}
+	freeTileCache(server.cache);
+	freeWorkers(workers, workerCount, server.paletteCount);
+	printf("Server stopped\n");
+	return started < workerCount;
+}
@@ -9,67 +9,688 @@
 #include <stdlib.h>
 #include "ComplexNumber.h"
 #include "Mandelbrot.h"
+#include "MandelbrotSIMD.h"
+#include "MandelbrotFloat.h"
+#include "MandelbrotSpecialized.h"
+#include "Instrument.h"
 #include <sys/types.h>
+#include <string.h>
 
 /*
 This function returns the number of iterations before the initial point >= the threshold.
 If the threshold is not exceeded after maxiters, the function returns 0.
 */
 u_int64_t MandelbrotIterations(u_int64_t maxiters, ComplexNumber * point, double threshold)
+{
+	return MandelbrotIterationsValue(maxiters, ComplexToValue(point), ComplexAbsSquaredThreshold(threshold));
+}
+
+/*
+The hot loop behind MandelbrotIterations. z stays in registers, and |z|^2 is compared against
+thresholdSquared, which ComplexAbsSquaredThreshold picks so that the result matches the sqrt version exactly.
+*/
+u_int64_t MandelbrotIterationsValue(u_int64_t maxiters, ComplexValue point, double thresholdSquared)
 {
 	u_int64_t iters = 0;
-	struct ComplexNumber *complexY;
-	struct ComplexNumber *complexX = newComplexNumber(0, 0);
+	ComplexValue z = ComplexValueOf(0, 0);
 
 	while (iters <= maxiters) {
-		if (ComplexAbs(complexX) >= threshold) {
-			freeComplexNumber(complexX);
+		if (ComplexValueAbsSquared(z) >= thresholdSquared) {
 			return iters;
 		}
-		complexY = ComplexProduct(complexX, complexX);
-		freeComplexNumber(complexX);
-		complexX = ComplexSum(complexY, point);
-		freeComplexNumber(complexY);
+		z = ComplexValueSum(ComplexValueProduct(z, z), point);
 		iters += 1;
 	}
-	freeComplexNumber(complexX);
 	return 0;
 }
 
+int MandelbrotInteriorNamed(const char* name)
+{
+	if (strcmp(name, "off") == 0) {
+		return 0;
+	}
+	if (strcmp(name, "bulbs") == 0) {
+		return MANDELBROT_INTERIOR_BULBS;
+	}
+	if (strcmp(name, "cycles") == 0) {
+		return MANDELBROT_INTERIOR_CYCLES;
+	}
+	if (strcmp(name, "all") == 0) {
+		return MANDELBROT_INTERIOR_BULBS | MANDELBROT_INTERIOR_CYCLES;
+	}
+	return -1;
+}
+
+/*
+Brent's cycle detection: z is compared with a saved orbit value, and the saved value moves forward
+whenever the number of steps since it was saved reaches the next power of two.
+Every value between the saved one and z has already passed the escape test, so a repeat means the orbit never escapes.
+*/
+u_int64_t MandelbrotIterationsInterior(u_int64_t maxiters, ComplexValue point, double thresholdSquared, int interior)
+{
+	if ((interior & MANDELBROT_INTERIOR_BULBS) && thresholdSquared >= 4 && MandelbrotInBulbs(point)) {
+		return 0;
+	}
+	if (!(interior & MANDELBROT_INTERIOR_CYCLES)) {
+		return MandelbrotIterationsValue(maxiters, point, thresholdSquared);
+	}
+	u_int64_t iters = 0;
+	ComplexValue z = ComplexValueOf(0, 0);
+	ComplexValue saved = z;
+	u_int64_t power = 1;
+	u_int64_t steps = 0;
+
+	while (iters <= maxiters) {
+		if (ComplexValueAbsSquared(z) >= thresholdSquared) {
+			return iters;
+		}
+		z = ComplexValueSum(ComplexValueProduct(z, z), point);
+		iters += 1;
+		if (z.real == saved.real && z.imaginary == saved.imaginary) {
+			return 0;
+		}
+		steps += 1;
+		if (steps == power) {
+			saved = z;
+			power *= 2;
+			steps = 0;
+		}
+	}
+	return 0;
+}
+
+void MandelbrotRowScalar(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize)
+{
+	for (u_int64_t i = 0; i < count; i++) {
+		double real = row->realStart + (row->increments * (first + i * row->stride));
+		ComplexValue point = ComplexValueOf(real, row->imaginary);
+		u_int64_t iterations;
+		if (row->interior) {
+			iterations = MandelbrotIterationsInterior(row->maxiters, point, row->thresholdSquared, row->interior);
+		}
+		else {
+			iterations = MandelbrotIterationsValue(row->maxiters, point, row->thresholdSquared);
+		}
+		IterationStore(output, elementSize, i, iterations);
+	}
+}
+
+MandelbrotRowKernel MandelbrotRowKernelNamed(const char* name)
+{
+	if (strcmp(name, "auto") == 0) {
+		if (MandelbrotSIMDSupported("avx512")) {
+			return MandelbrotRowAVX512;
+		}
+		if (MandelbrotSIMDSupported("avx2")) {
+			return MandelbrotRowAVX2;
+		}
+		return MandelbrotRowScalar;
+	}
+	if (strcmp(name, "scalar") == 0) {
+		return MandelbrotRowScalar;
+	}
+	if (strcmp(name, "avx2") == 0 && MandelbrotSIMDSupported("avx2")) {
+		return MandelbrotRowAVX2;
+	}
+	if (strcmp(name, "avx512") == 0 && MandelbrotSIMDSupported("avx512")) {
+		return MandelbrotRowAVX512;
+	}
+	return NULL;
+}
+
+void MandelbrotDefaultSettings(MandelbrotSettings* settings)
+{
+	settings->rowKernel = NULL;
+	settings->pool = NULL;
+	settings->tileSize = MANDELBROT_DEFAULT_TILE_SIZE;
+	settings->interior = 0;
+	settings->subdivide = 0;
+	settings->perturbation = NULL;
+	settings->series = 0;
+	settings->precision = MANDELBROT_PRECISION_DOUBLE;
+}
+
+int MandelbrotPrecisionNamed(const char* name)
+{
+	if (strcmp(name, "double") == 0) {
+		return MANDELBROT_PRECISION_DOUBLE;
+	}
+	if (strcmp(name, "float") == 0) {
+		return MANDELBROT_PRECISION_FLOAT;
+	}
+	if (strcmp(name, "auto") == 0) {
+		return MANDELBROT_PRECISION_AUTO;
+	}
+	return -1;
+}
+
+int MandelbrotUsesFloat(int precision, double centerReal, double centerImaginary, double scale, u_int64_t resolution, u_int64_t max_iterations)
+{
+	if (precision == MANDELBROT_PRECISION_FLOAT) {
+		/* the float kernels count in 32 bits */
+		return max_iterations < (1ull << 31);
+	}
+	return precision == MANDELBROT_PRECISION_AUTO && MandelbrotFloatSuffices(centerReal, centerImaginary, scale, resolution, max_iterations);
+}
+
+/*
+Everything a tile needs to render its part of the grid.
+Pixel (row, column) sits at (realStart + increments * column) + (imaginaryStart - increments * row) i,
+or, when perturbed is set, is rendered by PerturbationRow instead of the kernel.
+*/
+typedef struct MandelbrotGrid
+{
+	MandelbrotRowKernel kernel;
+	MandelbrotRowKernel scalar; //Kernel for single pixels, in the same precision as kernel
+	MandelbrotRow row;
+	double imaginaryStart;
+	u_int64_t length;
+	u_int64_t tileSize;
+	u_int64_t tilesPerRow;
+	u_int64_t top;    //First row rendered, which is the first row of output
+	u_int64_t bottom; //Row after the last one rendered
+	u_int64_t* mirror; //For each row from top, the row it is copied from once the tiles are done, or the row itself; or NULL
+	int subdivide;
+	int perturbed;
+	PerturbationFrame perturbation;
+	IterationMap* output;
+	const PaletteTable* palette; //Set, along with rgb, when rendering straight to colors instead of into output
+	uint8_t* rgb;
+#ifdef MANDEL_INSTRUMENT
+	InstrumentFrame* instrument; //The frame tiles are recorded into, or NULL
+	u_int64_t* copies;           //For each row from top, how many rows mirror copies from it; or NULL
+#endif
+} MandelbrotGrid;
+
+#ifdef MANDEL_INSTRUMENT
+//Counts of the tile the calling thread is rendering, or NULL
+static __thread InstrumentCounts* tileCounts = NULL;
+
+//Adds count pixels of row to the tile's counts, once for the row and once more for every row copied from it
+static void instrumentRow(const MandelbrotGrid* grid, u_int64_t row, const void* data, int elementSize, u_int64_t count)
+{
+	u_int64_t times = 1 + (grid->copies != NULL ? grid->copies[row - grid->top] : 0);
+	for (u_int64_t i = 0; i < times; i++) {
+		InstrumentCountsAdd(tileCounts, data, elementSize, count, grid->row.maxiters);
+	}
+}
+#endif
+
+//Pixels rendered at a time through a buffer on the stack, when they can't go straight into the map
+#define MANDELBROT_ROW_CHUNK 256
+
+//Stores the counts of count pixels of the given row, starting at firstColumn, into output as elementSize-byte counts
+static void gridCounts(const MandelbrotGrid* grid, u_int64_t row, u_int64_t firstColumn, u_int64_t count, void* output, int elementSize)
+{
+	if (grid->perturbed) {
+		PerturbationRow(&grid->perturbation, row, firstColumn, count, output, elementSize);
+	}
+	else {
+		MandelbrotRow line = grid->row;
+		line.imaginary = grid->imaginaryStart - (line.increments * row);
+		grid->kernel(&line, firstColumn, count, output, elementSize);
+	}
+	INSTRUMENT(if (tileCounts != NULL) instrumentRow(grid, row, output, elementSize, count));
+}
+
+//Renders count pixels of the given row, starting at firstColumn
+static void gridRow(const MandelbrotGrid* grid, u_int64_t row, u_int64_t firstColumn, u_int64_t count)
+{
+	if (grid->rgb != NULL) {
+		/* counts only live in a small buffer on their way to becoming colors */
+		u_int64_t counts[MANDELBROT_ROW_CHUNK];
+		int elementSize = IterationMapElementSize(grid->row.maxiters);
+		for (u_int64_t done = 0; done < count; done += MANDELBROT_ROW_CHUNK) {
+			u_int64_t chunk = count - done < MANDELBROT_ROW_CHUNK ? count - done : MANDELBROT_ROW_CHUNK;
+			gridCounts(grid, row, firstColumn + done, chunk, counts, elementSize);
+			PaletteColorize(grid->palette, counts, elementSize, chunk, grid->rgb + 3 * ((row - grid->top) * grid->length + firstColumn + done));
+		}
+		return;
+	}
+	void* start = (char*) IterationMapRow(grid->output, row - grid->top) + firstColumn * grid->output->elementSize;
+	gridCounts(grid, row, firstColumn, count, start, grid->output->elementSize);
+}
+
+//Renders count pixels of the given column, starting at firstRow. Single pixels go through the scalar kernel, which wastes no SIMD lanes.
+static void gridColumn(const MandelbrotGrid* grid, u_int64_t column, u_int64_t firstRow, u_int64_t count)
+{
+	MandelbrotRow line = grid->row;
+	for (u_int64_t row = firstRow; row < firstRow + count; row++) {
+		if (grid->perturbed) {
+			gridRow(grid, row, column, 1);
+			continue;
+		}
+		line.imaginary = grid->imaginaryStart - (line.increments * row);
+		void* start = (char*) IterationMapRow(grid->output, row) + column * grid->output->elementSize;
+		grid->scalar(&line, column, 1, start, grid->output->elementSize);
+		INSTRUMENT(if (tileCounts != NULL) InstrumentCountsAdd(tileCounts, start, grid->output->elementSize, 1, grid->row.maxiters));
+	}
+}
+
+//Rectangles narrower or shorter than this are finished by running the row kernel over their inside, row by row, instead of being split again
+#define MANDELBROT_SUBDIVIDE_MINIMUM 16
+
+/*
+Mariani-Silver subdivision of the rectangle with corners (top, left) and (bottom, right), whose border is already rendered.
+If the whole border has one iteration count, the interior is filled with it without being iterated.
+Otherwise the rectangle is cut into four by a middle row and a middle column, which are rendered, and each quarter is handled the same way.
+This assumes the set has no detail hidden entirely inside a uniform border, so it can differ from per-pixel rendering.
+*/
+static void subdivideRectangle(const MandelbrotGrid* grid, u_int64_t top, u_int64_t left, u_int64_t bottom, u_int64_t right)
+{
+	IterationMap* map = grid->output;
+	if (bottom - top < 2 || right - left < 2) {
+		return;
+	}
+	u_int64_t value = IterationMapGet(map, top * map->size + left);
+	int uniform = 1;
+	for (u_int64_t column = left; column <= right && uniform; column++) {
+		uniform = IterationMapGet(map, top * map->size + column) == value && IterationMapGet(map, bottom * map->size + column) == value;
+	}
+	for (u_int64_t row = top + 1; row < bottom && uniform; row++) {
+		uniform = IterationMapGet(map, row * map->size + left) == value && IterationMapGet(map, row * map->size + right) == value;
+	}
+	if (uniform) {
+		for (u_int64_t row = top + 1; row < bottom; row++) {
+			for (u_int64_t column = left + 1; column < right; column++) {
+				IterationMapSet(map, row * map->size + column, value);
+			}
+		}
+		return;
+	}
+	/* narrow rectangles are cheaper to finish with whole SIMD rows than to split into scalar columns again */
+	if (bottom - top < MANDELBROT_SUBDIVIDE_MINIMUM || right - left < MANDELBROT_SUBDIVIDE_MINIMUM) {
+		for (u_int64_t row = top + 1; row < bottom; row++) {
+			gridRow(grid, row, left + 1, right - left - 1);
+		}
+		return;
+	}
+	u_int64_t middleRow = (top + bottom) / 2;
+	u_int64_t middleColumn = (left + right) / 2;
+	gridRow(grid, middleRow, left + 1, right - left - 1);
+	gridColumn(grid, middleColumn, top + 1, middleRow - top - 1);
+	gridColumn(grid, middleColumn, middleRow + 1, bottom - middleRow - 1);
+	subdivideRectangle(grid, top, left, middleRow, middleColumn);
+	subdivideRectangle(grid, top, middleColumn, middleRow, right);
+	subdivideRectangle(grid, middleRow, left, bottom, middleColumn);
+	subdivideRectangle(grid, middleRow, middleColumn, bottom, right);
+}
+
+//Renders the border of the tile, then lets subdivideRectangle fill in the rest
+static void subdivideTile(const MandelbrotGrid* grid, u_int64_t firstRow, u_int64_t firstColumn, u_int64_t lastRow, u_int64_t width)
+{
+	u_int64_t bottom = lastRow - 1;
+	u_int64_t right = firstColumn + width - 1;
+	gridRow(grid, firstRow, firstColumn, width);
+	if (bottom > firstRow) {
+		gridRow(grid, bottom, firstColumn, width);
+	}
+	if (bottom > firstRow + 1) {
+		gridColumn(grid, firstColumn, firstRow + 1, bottom - firstRow - 1);
+		if (right > firstColumn) {
+			gridColumn(grid, right, firstRow + 1, bottom - firstRow - 1);
+		}
+	}
+	subdivideRectangle(grid, firstRow, firstColumn, bottom, right);
+}
+
+//Renders tile number tile, counting tiles row by row from the top left corner
+static void MandelbrotTile(void* arg, u_int64_t tile, int worker)
+{
+	MandelbrotGrid* grid = (MandelbrotGrid*) arg;
+	u_int64_t firstRow = grid->top + (tile / grid->tilesPerRow) * grid->tileSize;
+	u_int64_t firstColumn = (tile % grid->tilesPerRow) * grid->tileSize;
+	u_int64_t lastRow = firstRow + grid->tileSize;
+	u_int64_t width = grid->tileSize;
+	if (lastRow > grid->bottom) {
+		lastRow = grid->bottom;
+	}
+	if (firstColumn + width > grid->length) {
+		width = grid->length - firstColumn;
+	}
+#ifdef MANDEL_INSTRUMENT
+	InstrumentCounts counts;
+	InstrumentTime start = InstrumentNow();
+	if (grid->instrument != NULL) {
+		memset(&counts, 0, sizeof(counts));
+		tileCounts = &counts;
+	}
+#endif
+	if (grid->subdivide) {
+		subdivideTile(grid, firstRow, firstColumn, lastRow, width);
+	}
+	else {
+		for (u_int64_t row = firstRow; row < lastRow; row++) {
+			if (grid->mirror == NULL || grid->mirror[row - grid->top] == row) {
+				gridRow(grid, row, firstColumn, width);
+			}
+		}
+	}
+#ifdef MANDEL_INSTRUMENT
+	if (grid->instrument != NULL) {
+		tileCounts = NULL;
+		InstrumentTileEnd(grid->instrument, tile, firstRow, firstColumn, width, lastRow - firstRow, &counts, start);
+	}
+#endif
+}
+
 /*
 This function calculates the Mandelbrot plot and stores the result in output.
 The number of pixels in the image is resolution * 2 + 1 in one row/column. It's a square image.
 Scale is the the distance between center and the top pixel in one dimension.
 */
 void Mandelbrot(double threshold, u_int64_t max_iterations, ComplexNumber* center, double scale, u_int64_t resolution, u_int64_t * output) {
-	double realCenter = Re(center);
-	double imCenter = Im(center);
+	IterationMap map = IterationMapWrap(output, 2 * resolution + 1);
+	MandelbrotRender(NULL, threshold, max_iterations, center, scale, resolution, &map);
+}
+
+/*
+Fills grid for the given frame. Returns 0 for resolution 0, where there is no grid to speak of.
+*/
+static int gridInit(MandelbrotGrid* grid, const MandelbrotSettings* settings, double threshold, u_int64_t max_iterations, ComplexNumber* center, double scale, u_int64_t resolution, IterationMap* output)
+{
 	if (resolution == 0) {
-		output[0] = MandelbrotIterations(max_iterations, center, threshold);
+		return 0;
 	}
-	else {
-		double increments = scale/resolution;
-		double imaginary;
-		double real;
-
-		u_int64_t length = (2 * resolution + 1);
-		u_int64_t height = 0;
-		u_int64_t width = 0;
-		u_int64_t index = 0;
-		while (height < length) {
-			imaginary = imCenter + scale - (increments * height);
-			while (width < length) {
-				real = realCenter - scale + (increments * width);
-				ComplexNumber *newPoint = newComplexNumber(real, imaginary);
-				output[index] = MandelbrotIterations(max_iterations, newPoint, threshold);
-				freeComplexNumber(newPoint);
-				index += 1;
-				width += 1;
+	/* same expressions as the original per-pixel loop, so every point is rounded identically */
+	grid->kernel = settings->rowKernel != NULL ? settings->rowKernel : MandelbrotRowKernelNamed("auto");
+	grid->scalar = MandelbrotRowScalar;
+	if (MandelbrotUsesFloat(settings->precision, Re(center), Im(center), scale, resolution, max_iterations)) {
+		grid->kernel = MandelbrotFloatKernel(settings->rowKernel);
+		grid->scalar = MandelbrotRowFloat;
+	}
+	grid->row.maxiters = max_iterations;
+	grid->row.thresholdSquared = ComplexAbsSquaredThreshold(threshold);
+	grid->row.increments = scale/resolution;
+	grid->row.realStart = Re(center) - scale;
+	grid->row.imaginary = 0;
+	grid->row.interior = settings->interior;
+	grid->row.stride = 1;
+	/* a kernel chosen by name runs as it is, so --kernel can still pick the generic ones */
+	if (settings->rowKernel == NULL) {
+		grid->kernel = MandelbrotSpecializedKernel(grid->kernel, &grid->row);
+	}
+	grid->imaginaryStart = Im(center) + scale;
+	grid->length = 2 * resolution + 1;
+	grid->tileSize = settings->tileSize > 0 ? settings->tileSize : MANDELBROT_DEFAULT_TILE_SIZE;
+	if (settings->subdivide && grid->tileSize < MANDELBROT_SUBDIVIDE_TILE_SIZE) {
+		grid->tileSize = MANDELBROT_SUBDIVIDE_TILE_SIZE;
+	}
+	grid->tilesPerRow = (grid->length + grid->tileSize - 1) / grid->tileSize;
+	grid->top = 0;
+	grid->bottom = grid->length;
+	grid->mirror = NULL;
+	grid->subdivide = settings->subdivide;
+	grid->perturbed = settings->perturbation != NULL && PerturbationOrbitMatches(settings->perturbation, center, max_iterations, threshold);
+	if (grid->perturbed) {
+		PerturbationFrameInit(&grid->perturbation, settings->perturbation, scale, resolution, settings->series);
+	}
+	grid->output = output;
+	grid->palette = NULL;
+	grid->rgb = NULL;
+	INSTRUMENT(grid->instrument = InstrumentCurrentFrame());
+	INSTRUMENT(grid->copies = NULL);
+	return 1;
+}
+
+//Returns the number of tiles covering the rows from top to bottom
+static u_int64_t gridTiles(const MandelbrotGrid* grid)
+{
+	return grid->tilesPerRow * ((grid->bottom - grid->top + grid->tileSize - 1) / grid->tileSize);
+}
+
+//The imaginary part of every pixel of the given row, computed exactly like gridCounts does
+static double gridImaginary(const MandelbrotGrid* grid, u_int64_t row)
+{
+	return grid->imaginaryStart - (grid->row.increments * row);
+}
+
+/*
+The set is symmetric about the real axis, and the iteration is too, bit for bit: conjugating c negates the imaginary
+part of every z, and rounding to nearest commutes with negation, so c and its conjugate escape after the same number
+of iterations. This returns the mirror table for grid: each row below the axis whose imaginary part is exactly the
+negation of a row above it, within top to bottom, is copied from that row. Rows on the pixel grid only line up like
+this when the center and the pixel step allow it, so the table is looked up value by value rather than assumed.
+Returns NULL when no row can be copied, or if the table could not be allocated, which just renders every row.
+*/
+static u_int64_t* gridMirror(const MandelbrotGrid* grid)
+{
+	if (!(gridImaginary(grid, grid->top) > 0 && gridImaginary(grid, grid->bottom - 1) < 0)) {
+		return NULL;
+	}
+	u_int64_t* mirror = (u_int64_t*) malloc((grid->bottom - grid->top) * sizeof(u_int64_t));
+	if (mirror == NULL) {
+		return NULL;
+	}
+	int mirrored = 0;
+	for (u_int64_t row = grid->top; row < grid->bottom; row++) {
+		mirror[row - grid->top] = row;
+		double imaginary = gridImaginary(grid, row);
+		if (!(imaginary < 0)) {
+			continue;
+		}
+		/* the imaginary parts never increase from one row to the next, so the row above the axis is found by bisection */
+		u_int64_t low = grid->top;
+		u_int64_t high = row;
+		while (low < high) {
+			u_int64_t middle = low + (high - low) / 2;
+			if (gridImaginary(grid, middle) > -imaginary) {
+				low = middle + 1;
+			}
+			else {
+				high = middle;
 			}
-			height += 1;
-			width = 0;
 		}
+		if (low < row && gridImaginary(grid, low) == -imaginary) {
+			mirror[row - grid->top] = low;
+			mirrored = 1;
+		}
+	}
+	if (!mirrored) {
+		free(mirror);
+		return NULL;
 	}
+	return mirror;
 }
 
+//Copies every row the mirror table points elsewhere from its source row, which the tiles have rendered in full
+static void gridCopyMirrored(const MandelbrotGrid* grid)
+{
+	for (u_int64_t row = grid->top; row < grid->bottom; row++) {
+		u_int64_t source = grid->mirror[row - grid->top];
+		if (source == row) {
+			continue;
+		}
+		if (grid->rgb != NULL) {
+			memcpy(grid->rgb + 3 * (row - grid->top) * grid->length, grid->rgb + 3 * (source - grid->top) * grid->length, 3 * grid->length);
+		}
+		else {
+			memcpy(IterationMapRow(grid->output, row - grid->top), IterationMapRow(grid->output, source - grid->top), grid->length * grid->output->elementSize);
+		}
+	}
+}
 
+/*
+Runs MandelbrotTile on every tile of grid, over the pool when there is one.
+Rows mirrored across the real axis are skipped by the tiles and copied at the end. Subdivision works on whole
+tiles and perturbation on an orbit that is not symmetric, so neither is mirrored.
+*/
+static void gridRender(const MandelbrotSettings* settings, MandelbrotGrid* grid)
+{
+	grid->mirror = grid->subdivide || grid->perturbed ? NULL : gridMirror(grid);
+#ifdef MANDEL_INSTRUMENT
+	/* copied rows are never counted by a tile, so the tile that renders their source counts them too */
+	if (grid->mirror != NULL && grid->instrument != NULL) {
+		grid->copies = (u_int64_t*) calloc(grid->bottom - grid->top, sizeof(u_int64_t));
+		for (u_int64_t row = grid->top; grid->copies != NULL && row < grid->bottom; row++) {
+			if (grid->mirror[row - grid->top] != row) {
+				grid->copies[grid->mirror[row - grid->top] - grid->top] += 1;
+			}
+		}
+	}
+#endif
+	u_int64_t tiles = gridTiles(grid);
+	if (settings->pool != NULL) {
+		ThreadPoolRun(settings->pool, tiles, MandelbrotTile, grid);
+	}
+	else {
+		for (u_int64_t tile = 0; tile < tiles; tile++) {
+			MandelbrotTile(grid, tile, 0);
+		}
+	}
+	if (grid->mirror != NULL) {
+		gridCopyMirrored(grid);
+		free(grid->mirror);
+		grid->mirror = NULL;
+	}
+	INSTRUMENT(free(grid->copies));
+	INSTRUMENT(grid->copies = NULL);
+}
+
+//Renders the single pixel of a resolution 0 frame: the center itself
+static void renderCenter(const MandelbrotSettings* settings, double threshold, u_int64_t max_iterations, ComplexNumber* center, IterationMap* output)
+{
+	IterationMapSet(output, 0, MandelbrotIterationsInterior(max_iterations, ComplexToValue(center), ComplexAbsSquaredThreshold(threshold), settings->interior));
+}
+
+void MandelbrotRender(const MandelbrotSettings* settings, double threshold, u_int64_t max_iterations, ComplexNumber* center, double scale, u_int64_t resolution, IterationMap* output) {
+	MandelbrotSettings defaults;
+	if (settings == NULL) {
+		MandelbrotDefaultSettings(&defaults);
+		settings = &defaults;
+	}
+	MandelbrotGrid grid;
+	if (!gridInit(&grid, settings, threshold, max_iterations, center, scale, resolution, output)) {
+		renderCenter(settings, threshold, max_iterations, center, output);
+		return;
+	}
+	gridRender(settings, &grid);
+}
+
+void MandelbrotRenderRows(const MandelbrotSettings* settings, double threshold, u_int64_t max_iterations, ComplexNumber* center, double scale, u_int64_t resolution, u_int64_t firstRow, u_int64_t rows, IterationMap* output) {
+	MandelbrotSettings defaults;
+	if (settings == NULL) {
+		MandelbrotDefaultSettings(&defaults);
+		settings = &defaults;
+	}
+	MandelbrotGrid grid;
+	if (!gridInit(&grid, settings, threshold, max_iterations, center, scale, resolution, output)) {
+		renderCenter(settings, threshold, max_iterations, center, output);
+		return;
+	}
+	/* tiles start at firstRow, so a band is tiled as if it were a frame of its own */
+	grid.subdivide = 0;
+	grid.tileSize = settings->tileSize > 0 ? settings->tileSize : MANDELBROT_DEFAULT_TILE_SIZE;
+	grid.tilesPerRow = (grid.length + grid.tileSize - 1) / grid.tileSize;
+	grid.top = firstRow;
+	grid.bottom = firstRow + rows;
+	gridRender(settings, &grid);
+}
+
+//Renders count pixels of the given row at columns first, first+stride, ..., leaving the columns in between alone
+static void gridSparseRow(const MandelbrotGrid* grid, u_int64_t row, u_int64_t first, u_int64_t stride, u_int64_t count)
+{
+	IterationMap* map = grid->output;
+	if (stride == 1) {
+		gridRow(grid, row, first, count);
+		return;
+	}
+	if (grid->perturbed) {
+		for (u_int64_t i = 0; i < count; i++) {
+			gridRow(grid, row, first + i * stride, 1);
+		}
+		return;
+	}
+	MandelbrotRow line = grid->row;
+	line.imaginary = grid->imaginaryStart - (line.increments * row);
+	line.stride = stride;
+	u_int64_t counts[MANDELBROT_ROW_CHUNK];
+	for (u_int64_t done = 0; done < count; done += MANDELBROT_ROW_CHUNK) {
+		u_int64_t chunk = count - done < MANDELBROT_ROW_CHUNK ? count - done : MANDELBROT_ROW_CHUNK;
+		u_int64_t column = first + done * stride;
+		grid->kernel(&line, column, chunk, counts, sizeof(u_int64_t));
+		for (u_int64_t i = 0; i < chunk; i++) {
+			IterationMapSet(map, row * map->size + column + i * stride, counts[i]);
+		}
+	}
+}
+
+void MandelbrotRenderRGB(const MandelbrotSettings* settings, double threshold, u_int64_t max_iterations, ComplexNumber* center, double scale, u_int64_t resolution, const PaletteTable* palette, uint8_t* rgb) {
+	MandelbrotSettings defaults;
+	if (settings == NULL) {
+		MandelbrotDefaultSettings(&defaults);
+		settings = &defaults;
+	}
+	MandelbrotGrid grid;
+	if (!gridInit(&grid, settings, threshold, max_iterations, center, scale, resolution, NULL)) {
+		PaletteColor(palette, MandelbrotIterationsInterior(max_iterations, ComplexToValue(center), ComplexAbsSquaredThreshold(threshold), settings->interior), rgb);
+		return;
+	}
+	/* subdivision compares counts across the tile, which are never stored here */
+	grid.subdivide = 0;
+	grid.tileSize = settings->tileSize > 0 ? settings->tileSize : MANDELBROT_DEFAULT_TILE_SIZE;
+	grid.tilesPerRow = (grid.length + grid.tileSize - 1) / grid.tileSize;
+	grid.palette = palette;
+	grid.rgb = rgb;
+	gridRender(settings, &grid);
+}
+
+//One pass of MandelbrotProgressive: task k renders row k * step
+typedef struct MandelbrotPass
+{
+	const MandelbrotGrid* grid;
+	u_int64_t step;
+} MandelbrotPass;
+
+/*
+Renders the pixels of row task * step that are on this pass's lattice but not on the previous one.
+On rows the previous pass covered, those are the odd multiples of step; on the other rows, every multiple of step.
+*/
+static void MandelbrotPassRow(void* arg, u_int64_t task, int worker)
+{
+	MandelbrotPass* pass = (MandelbrotPass*) arg;
+	u_int64_t step = pass->step;
+	u_int64_t row = task * step;
+	u_int64_t first = 0;
+	u_int64_t stride = step;
+	if (step < MANDELBROT_PROGRESSIVE_STEP && row % (2 * step) == 0) {
+		first = step;
+		stride = 2 * step;
+	}
+	if (first >= pass->grid->length) {
+		return;
+	}
+	gridSparseRow(pass->grid, row, first, stride, (pass->grid->length - 1 - first) / stride + 1);
+}
+
+void MandelbrotProgressive(const MandelbrotSettings* settings, double threshold, u_int64_t max_iterations, ComplexNumber* center, double scale, u_int64_t resolution, IterationMap* output, MandelbrotPassCallback callback, void* arg) {
+	MandelbrotSettings defaults;
+	if (settings == NULL) {
+		MandelbrotDefaultSettings(&defaults);
+		settings = &defaults;
+	}
+	MandelbrotGrid grid;
+	if (!gridInit(&grid, settings, threshold, max_iterations, center, scale, resolution, output)) {
+		renderCenter(settings, threshold, max_iterations, center, output);
+		if (callback != NULL) {
+			callback(arg, 1, output);
+		}
+		return;
+	}
+	MandelbrotPass pass;
+	pass.grid = &grid;
+	for (pass.step = MANDELBROT_PROGRESSIVE_STEP; pass.step > 0; pass.step /= 2) {
+		u_int64_t rows = (grid.length - 1) / pass.step + 1;
+		if (settings->pool != NULL) {
+			ThreadPoolRun(settings->pool, rows, MandelbrotPassRow, &pass);
+		}
+		else {
+			for (u_int64_t row = 0; row < rows; row++) {
+				MandelbrotPassRow(&pass, row, 0);
+			}
+		}
+		if (callback != NULL) {
+			callback(arg, pass.step, output);
+		}
+	}
+}
@@ -5,9 +5,17 @@
 ** Modified for this class by Justin Yokota and Chenyu Shi
 **********************/
 
+#ifndef MANDELBROT_H
+#define MANDELBROT_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include "ComplexNumber.h"
+#include "ThreadPool.h"
+#include "IterationMap.h"
+#include "Perturbation.h"
+#include "Palette.h"
 
 /*
 This function returns the number of iterations that cause the initial point to exceed the threshold.
@@ -15,6 +23,108 @@ If the threshold is not exceeded after maxiters, the function returns maxiters.
 */
 u_int64_t MandelbrotIterations(u_int64_t maxiters, ComplexNumber * point, double threshold);
 
+/*
+Same as MandelbrotIterations, but allocation free: the point is passed by value and the threshold
+is given as thresholdSquared = ComplexAbsSquaredThreshold(threshold), so no sqrt is taken per iteration.
+*/
+u_int64_t MandelbrotIterationsValue(u_int64_t maxiters, ComplexValue point, double thresholdSquared);
+
+/*
+Opt-in shortcuts for points inside the set. Both give exactly the answer of the full loop (0), just sooner.
+MANDELBROT_INTERIOR_BULBS: points in the main cardioid or the period-2 bulb are answered with a closed-form test,
+	without iterating. Only used when the threshold is at least 2, since orbits inside the set never reach 2.
+	Points within rounding distance of the cardioid's edge need around 10^8 iterations or more to escape, so the
+	test agrees with the loop for any practical max_iterations.
+MANDELBROT_INTERIOR_CYCLES: Brent cycle detection on the orbit. Once z repeats a value bit for bit, the
+	orbit is periodic and none of its values escaped, so the loop can stop. This one is exact for any input.
+*/
+#define MANDELBROT_INTERIOR_BULBS 1
+#define MANDELBROT_INTERIOR_CYCLES 2
+
+//Returns 1 if point is inside the main cardioid or the period-2 bulb
+static inline int MandelbrotInBulbs(ComplexValue point)
+{
+	double x = point.real - 0.25;
+	double y2 = point.imaginary * point.imaginary;
+	double q = (x * x) + y2;
+	double bulb = point.real + 1;
+	return (q * (q + x) <= 0.25 * y2) || ((bulb * bulb) + y2 <= 0.0625);
+}
+
+//Returns the MANDELBROT_INTERIOR_* flags called name ("off", "bulbs", "cycles" or "all"), or -1 for an unknown name
+int MandelbrotInteriorNamed(const char* name);
+
+/*
+MandelbrotIterationsValue with the interior shortcuts selected by the MANDELBROT_INTERIOR_* flags in interior.
+*/
+u_int64_t MandelbrotIterationsInterior(u_int64_t maxiters, ComplexValue point, double thresholdSquared, int interior);
+
+/*
+One row of pixels, as seen by a row kernel: the pixel in column c sits at (realStart + increments * c) + imaginary i.
+*/
+typedef struct MandelbrotRow
+{
+	u_int64_t maxiters;
+	double thresholdSquared;
+	double realStart;
+	double increments;
+	double imaginary;
+	int interior;     //MANDELBROT_INTERIOR_* flags
+	u_int64_t stride; //Distance between the columns of consecutive output elements, normally 1
+} MandelbrotRow;
+
+/*
+A row kernel fills elements 0..count-1 of output with the iterations of the pixels at columns first, first+stride, ..., first+(count-1)*stride of row.
+output holds elementSize-byte counts (see IterationMap.h), and kernels store straight into that width.
+*/
+typedef void (*MandelbrotRowKernel)(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+
+//The reference row kernel: one pixel at a time through MandelbrotIterationsValue, or MandelbrotIterationsInterior when row->interior is set
+void MandelbrotRowScalar(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+
+/*
+Returns the row kernel called name ("scalar", "avx2", "avx512" or "auto"), or NULL if this CPU can't run it.
+"auto" picks the widest SIMD kernel the CPU supports according to CPUID, and falls back to the scalar kernel.
+*/
+MandelbrotRowKernel MandelbrotRowKernelNamed(const char* name);
+
+/*
+The arithmetic row kernels iterate in. Only double is exact; float (see MandelbrotFloat.h) is twice as wide per vector
+but can be off by a few iterations near the boundary. Auto picks float for every frame MandelbrotFloatSuffices
+allows and double for the rest, so a zoom moves from one to the other as it deepens.
+*/
+#define MANDELBROT_PRECISION_DOUBLE 0
+#define MANDELBROT_PRECISION_FLOAT 1
+#define MANDELBROT_PRECISION_AUTO 2
+
+//Returns the MANDELBROT_PRECISION_* value called name ("double", "float" or "auto"), or -1 for an unknown name
+int MandelbrotPrecisionNamed(const char* name);
+
+//Returns 1 if a frame with these parameters would be rendered in float with the given MANDELBROT_PRECISION_* value
+int MandelbrotUsesFloat(int precision, double centerReal, double centerImaginary, double scale, u_int64_t resolution, u_int64_t max_iterations);
+
+/*
+Options for MandelbrotRender. Start from MandelbrotDefaultSettings and change what you need.
+*/
+typedef struct MandelbrotSettings
+{
+	MandelbrotRowKernel rowKernel; //NULL means MandelbrotRowKernelNamed("auto")
+	ThreadPool* pool;              //Tiles are spread over this pool; NULL renders on the calling thread
+	u_int64_t tileSize;            //Width and height of a tile in pixels
+	int interior;                  //MANDELBROT_INTERIOR_* shortcuts to use, 0 for none
+	int subdivide;                 //1 to fill tiles by Mariani-Silver subdivision instead of rendering every pixel (not exact)
+	const PerturbationOrbit* perturbation; //Render by perturbation around this orbit when it matches the frame's center, threshold and max_iterations
+	int series;                    //1 to let perturbation skip early iterations by series approximation
+	int precision;                 //MANDELBROT_PRECISION_* arithmetic of the row kernel; perturbation is always double
+} MandelbrotSettings;
+
+#define MANDELBROT_DEFAULT_TILE_SIZE 32
+//Smallest tile used with subdivide: bigger rectangles leave more room to skip uniform regions
+#define MANDELBROT_SUBDIVIDE_TILE_SIZE 128
+
+//Fills settings with the defaults used by Mandelbrot
+void MandelbrotDefaultSettings(MandelbrotSettings* settings);
+
 
 /*
 This function calculates the Mandelbrot plot and stores the result in output.
@@ -22,3 +132,44 @@ The number of pixels in the image is resolution * 2 + 1 in one row/column. It's
 Scale is the the distance between center and the top pixel in one dimension.
 */
 void Mandelbrot(double threshold, u_int64_t max_iterations, ComplexNumber* center, double scale, u_int64_t resolution, u_int64_t * output);
+
+/*
+Same as Mandelbrot, with the given settings, storing into an iteration map of any element size.
+output must have been made for this resolution, with elements wide enough for max_iterations.
+settings may be NULL for the defaults.
+*/
+void MandelbrotRender(const MandelbrotSettings* settings, double threshold, u_int64_t max_iterations, ComplexNumber* center, double scale, u_int64_t resolution, IterationMap* output);
+
+/*
+Same as MandelbrotRender, but only for rows firstRow to firstRow + rows - 1 of the frame, which are stored from the
+first row of output on. output needs room for rows rows of 2 * resolution + 1 counts, as made by newIterationBand.
+The counts are exactly those of the same rows of a whole frame, so bands rendered separately can be put back together.
+settings->subdivide is ignored, since subdivision would make the counts depend on where the bands are cut.
+*/
+void MandelbrotRenderRows(const MandelbrotSettings* settings, double threshold, u_int64_t max_iterations, ComplexNumber* center, double scale, u_int64_t resolution, u_int64_t firstRow, u_int64_t rows, IterationMap* output);
+
+/*
+Same as MandelbrotRender, but each tile turns its counts into colors as soon as they are computed and writes them to rgb,
+3 bytes per pixel row by row, which is exactly the pixel data of a P6 image. No iteration map is ever allocated.
+settings->subdivide is ignored, since subdivision needs the counts of the whole tile.
+*/
+void MandelbrotRenderRGB(const MandelbrotSettings* settings, double threshold, u_int64_t max_iterations, ComplexNumber* center, double scale, u_int64_t resolution, const PaletteTable* palette, uint8_t* rgb);
+
+/*
+Called by MandelbrotProgressive after each pass. Pixels whose row and column are both multiples of step hold their
+final counts; the others are not computed yet. The last pass has step 1.
+*/
+typedef void (*MandelbrotPassCallback)(void* arg, u_int64_t step, const IterationMap* output);
+
+//Spacing of the first, coarsest pass of MandelbrotProgressive
+#define MANDELBROT_PROGRESSIVE_STEP 8
+
+/*
+Same as MandelbrotRender, but coarse to fine: the first pass computes every 8th pixel of every 8th row, and each
+following pass halves the spacing, computing only the pixels no earlier pass has. callback, if not NULL, sees the
+map after every pass, so a preview is available after 1/64th of the work. The final map is identical to
+MandelbrotRender's. settings->subdivide is ignored.
+*/
+void MandelbrotProgressive(const MandelbrotSettings* settings, double threshold, u_int64_t max_iterations, ComplexNumber* center, double scale, u_int64_t resolution, IterationMap* output, MandelbrotPassCallback callback, void* arg);
+
+#endif
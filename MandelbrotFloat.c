@@ -0,0 +1,186 @@
+/*********************
+**  Mandelbrot fractal, single-precision row kernels
+**  The vector kernels mirror MandelbrotRowAVX2 and MandelbrotRowAVX512 with float lanes and 32-bit counters.
+**********************/
+
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "Mandelbrot.h"
+#include "MandelbrotSIMD.h"
+#include "MandelbrotFloat.h"
+
+void MandelbrotRowFloat(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize)
+{
+	const float threshold = (float) row->thresholdSquared;
+	const float ci = (float) row->imaginary;
+	for (u_int64_t i = 0; i < count; i++) {
+		float cr = (float) (row->realStart + (row->increments * (first + i * row->stride)));
+		float zr = 0;
+		float zi = 0;
+		u_int64_t iters = 0;
+		u_int64_t result = 0;
+		while (iters <= row->maxiters) {
+			float zr2 = zr * zr;
+			float zi2 = zi * zi;
+			if (zr2 + zi2 >= threshold) {
+				result = iters;
+				break;
+			}
+			float zrzi = zr * zi;
+			zr = (zr2 - zi2) + cr;
+			zi = (zrzi + zrzi) + ci;
+			iters += 1;
+		}
+		IterationStore(output, elementSize, i, result);
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+void MandelbrotRowFloatAVX2(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize)
+{
+	const __m256 threshold = _mm256_set1_ps((float) row->thresholdSquared);
+	const __m256d start = _mm256_set1_pd(row->realStart);
+	const __m256d step = _mm256_set1_pd(row->increments);
+	const __m256 ci = _mm256_set1_ps((float) row->imaginary);
+	const u_int64_t maxiters = row->maxiters;
+	const u_int64_t stride = row->stride;
+	u_int64_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		u_int64_t column = first + i * stride;
+		/* positions are computed in double, four at a time, and rounded to float like the scalar kernel does */
+		__m256d low = _mm256_set_pd((double) (column + 3 * stride), (double) (column + 2 * stride), (double) (column + stride), (double) column);
+		__m256d high = _mm256_set_pd((double) (column + 7 * stride), (double) (column + 6 * stride), (double) (column + 5 * stride), (double) (column + 4 * stride));
+		__m256 cr = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_add_pd(start, _mm256_mul_pd(step, high))),
+			_mm256_cvtpd_ps(_mm256_add_pd(start, _mm256_mul_pd(step, low))));
+		__m256 zr = _mm256_setzero_ps();
+		__m256 zi = _mm256_setzero_ps();
+		__m256i counters = _mm256_setzero_si256();
+		__m256i active = _mm256_set1_epi32(-1);
+		u_int64_t iters = 0;
+
+		while (iters <= maxiters) {
+			__m256 zr2 = _mm256_mul_ps(zr, zr);
+			__m256 zi2 = _mm256_mul_ps(zi, zi);
+			__m256 magnitude = _mm256_add_ps(zr2, zi2);
+			__m256i escaped = _mm256_castps_si256(_mm256_cmp_ps(magnitude, threshold, _CMP_GE_OQ));
+			active = _mm256_andnot_si256(escaped, active);
+			if (_mm256_testz_si256(active, active)) {
+				break;
+			}
+			counters = _mm256_sub_epi32(counters, active);
+			__m256 zrzi = _mm256_mul_ps(zr, zi);
+			zr = _mm256_add_ps(_mm256_sub_ps(zr2, zi2), cr);
+			zi = _mm256_add_ps(_mm256_add_ps(zrzi, zrzi), ci);
+			iters += 1;
+		}
+		counters = _mm256_andnot_si256(active, counters);
+		uint32_t lanes[8];
+		_mm256_storeu_si256((__m256i*) lanes, counters);
+		for (int lane = 0; lane < 8; lane++) {
+			IterationStore(output, elementSize, i + lane, lanes[lane]);
+		}
+	}
+	if (i < count) {
+		MandelbrotRowFloat(row, first + i * stride, count - i, (char*) output + i * elementSize, elementSize);
+	}
+}
+
+__attribute__((target("avx512f")))
+void MandelbrotRowFloatAVX512(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize)
+{
+	const __m512 threshold = _mm512_set1_ps((float) row->thresholdSquared);
+	const __m512d start = _mm512_set1_pd(row->realStart);
+	const __m512d step = _mm512_set1_pd(row->increments);
+	const __m512 ci = _mm512_set1_ps((float) row->imaginary);
+	const __m512i one = _mm512_set1_epi32(1);
+	const double stride = (double) row->stride;
+	const __m512d lowLanes = _mm512_mul_pd(_mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0), _mm512_set1_pd(stride));
+	const __m512d highLanes = _mm512_mul_pd(_mm512_set_pd(15, 14, 13, 12, 11, 10, 9, 8), _mm512_set1_pd(stride));
+	const u_int64_t maxiters = row->maxiters;
+
+	for (u_int64_t i = 0; i < count; i += 16) {
+		__mmask16 used = (count - i >= 16) ? 0xFFFF : (__mmask16) ((1u << (count - i)) - 1);
+		__m512d columns = _mm512_set1_pd((double) (first + i * row->stride));
+		__m256 low = _mm512_cvtpd_ps(_mm512_add_pd(start, _mm512_mul_pd(step, _mm512_add_pd(columns, lowLanes))));
+		__m256 high = _mm512_cvtpd_ps(_mm512_add_pd(start, _mm512_mul_pd(step, _mm512_add_pd(columns, highLanes))));
+		/* the two halves are joined through the double view of the register, which needs no AVX-512DQ */
+		__m512 cr = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(low)), _mm256_castps_pd(high), 1));
+		__m512 zr = _mm512_setzero_ps();
+		__m512 zi = _mm512_setzero_ps();
+		__m512i counters = _mm512_setzero_si512();
+		__mmask16 active = used;
+		u_int64_t iters = 0;
+
+		while (iters <= maxiters) {
+			__m512 zr2 = _mm512_mul_ps(zr, zr);
+			__m512 zi2 = _mm512_mul_ps(zi, zi);
+			__m512 magnitude = _mm512_add_ps(zr2, zi2);
+			active &= (__mmask16) ~_mm512_cmp_ps_mask(magnitude, threshold, _CMP_GE_OQ);
+			if (active == 0) {
+				break;
+			}
+			counters = _mm512_mask_add_epi32(counters, active, counters, one);
+			__m512 zrzi = _mm512_mul_ps(zr, zi);
+			zr = _mm512_add_ps(_mm512_sub_ps(zr2, zi2), cr);
+			zi = _mm512_add_ps(_mm512_add_ps(zrzi, zrzi), ci);
+			iters += 1;
+		}
+		counters = _mm512_maskz_mov_epi32((__mmask16) ~active, counters);
+		if (elementSize == 2) {
+			_mm512_mask_cvtepi32_storeu_epi16((uint16_t*) output + i, used, counters);
+		}
+		else if (elementSize == 4) {
+			_mm512_mask_storeu_epi32((uint32_t*) output + i, used, counters);
+		}
+		else {
+			_mm512_mask_storeu_epi64((u_int64_t*) output + i, (__mmask8) used, _mm512_cvtepu32_epi64(_mm512_castsi512_si256(counters)));
+			_mm512_mask_storeu_epi64((u_int64_t*) output + i + 8, (__mmask8) (used >> 8), _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(counters, 1)));
+		}
+	}
+}
+
+#else
+
+void MandelbrotRowFloatAVX2(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize)
+{
+	MandelbrotRowFloat(row, first, count, output, elementSize);
+}
+
+void MandelbrotRowFloatAVX512(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize)
+{
+	MandelbrotRowFloat(row, first, count, output, elementSize);
+}
+
+#endif
+
+MandelbrotRowKernel MandelbrotFloatKernel(MandelbrotRowKernel kernel)
+{
+	if (kernel == MandelbrotRowScalar) {
+		return MandelbrotRowFloat;
+	}
+	if (kernel == MandelbrotRowAVX2) {
+		return MandelbrotRowFloatAVX2;
+	}
+	if (kernel == MandelbrotRowAVX512 || MandelbrotSIMDSupported("avx512")) {
+		return MandelbrotRowFloatAVX512;
+	}
+	if (MandelbrotSIMDSupported("avx2")) {
+		return MandelbrotRowFloatAVX2;
+	}
+	return MandelbrotRowFloat;
+}
+
+int MandelbrotFloatSuffices(double centerReal, double centerImaginary, double scale, u_int64_t resolution, u_int64_t max_iterations)
+{
+	if (resolution == 0 || max_iterations >= (1ull << 31)) {
+		return 0;
+	}
+	double largest = fmax(fabs(centerReal), fabs(centerImaginary)) + scale;
+	/* floats are at most FLT_EPSILON * largest apart anywhere in the view */
+	return scale / resolution >= ldexp(FLT_EPSILON * largest, MANDELBROT_FLOAT_MARGIN);
+}
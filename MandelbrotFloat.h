@@ -0,0 +1,41 @@
+/*********************
+**  Mandelbrot fractal, single-precision row kernels
+**  Scalar, AVX2 (8 lanes) and AVX-512 (16 lanes) kernels that iterate in float instead of double,
+**  twice as many lanes per vector as the double kernels. They are not exact: pixels near the boundary of the set
+**  can escape a few iterations sooner or later than in double. MandelbrotFloatSuffices decides when a view is
+**  shallow enough for them, which is what MANDELBROT_PRECISION_AUTO goes by.
+**********************/
+
+#ifndef MANDELBROTFLOAT_H
+#define MANDELBROTFLOAT_H
+
+#include <sys/types.h>
+#include "Mandelbrot.h"
+
+/*
+Pixel positions are computed in double exactly like the double kernels, and only then rounded to float,
+so each pixel starts from the float nearest to its exact position. The iteration and the escape test
+((zr*zr) + (zi*zi) >= thresholdSquared) run in float, in the same operation order as the double kernels.
+Counts are kept in 32 bits, so max_iterations must be below 2^31. The interior shortcuts are not used.
+The SIMD kernels give exactly the counts of MandelbrotRowFloat; only call them when MandelbrotSIMDSupported says
+the CPU can run them.
+*/
+void MandelbrotRowFloat(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+void MandelbrotRowFloatAVX2(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+void MandelbrotRowFloatAVX512(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+
+//Returns the float kernel for the same instruction set as kernel, a double kernel, or NULL (auto) for the best one
+MandelbrotRowKernel MandelbrotFloatKernel(MandelbrotRowKernel kernel);
+
+//Neighbouring pixels must be at least 2^MANDELBROT_FLOAT_MARGIN float steps apart for MandelbrotFloatSuffices
+#define MANDELBROT_FLOAT_MARGIN 10
+
+/*
+Returns 1 if a frame is shallow enough to render in float: the distance between pixels, scale / resolution, is
+at least 2^MANDELBROT_FLOAT_MARGIN times the spacing of floats at the largest coordinate in view, and max_iterations
+fits the 32-bit counters. Pixels then sit within a thousandth of a pixel of their exact position; the
+differences that remain come from the iteration itself, and MandelFrame --precision-report counts them.
+*/
+int MandelbrotFloatSuffices(double centerReal, double centerImaginary, double scale, u_int64_t resolution, u_int64_t max_iterations);
+
+#endif
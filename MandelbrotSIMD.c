@@ -0,0 +1,218 @@
+/*********************
+**  Mandelbrot fractal, vectorized row kernels
+**  AVX2 (4 lanes) and AVX-512 (8 lanes) versions of MandelbrotRowScalar.
+**  Each kernel is compiled for its own instruction set through a target attribute, so the rest
+**  of the program stays generic and the kernel is only picked at runtime after a CPUID check.
+**********************/
+
+#include <string.h>
+#include "ComplexNumber.h"
+#include "Mandelbrot.h"
+#include "MandelbrotSIMD.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/*
+z*z + c is written out exactly like ComplexValueProduct followed by ComplexValueSum:
+  real      = ((zr*zr) - (zi*zi)) + cr
+  imaginary = ((zr*zi) + (zr*zi)) + ci
+Neither target below enables FMA on its own, and the Makefile passes -ffp-contract=off,
+so the products are rounded before they are added, just like in the scalar loop.
+The bulb test is MandelbrotInBulbs written out lane by lane.
+*/
+
+__attribute__((target("avx2")))
+void MandelbrotRowAVX2(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize)
+{
+	const __m256d threshold = _mm256_set1_pd(row->thresholdSquared);
+	const __m256d start = _mm256_set1_pd(row->realStart);
+	const __m256d step = _mm256_set1_pd(row->increments);
+	const __m256d ci = _mm256_set1_pd(row->imaginary);
+	const int bulbs = (row->interior & MANDELBROT_INTERIOR_BULBS) && row->thresholdSquared >= 4;
+	const int cycles = row->interior & MANDELBROT_INTERIOR_CYCLES;
+	const u_int64_t maxiters = row->maxiters;
+	const u_int64_t stride = row->stride;
+	u_int64_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		u_int64_t column = first + i * stride;
+		__m256d columns = _mm256_set_pd((double) (column + 3 * stride), (double) (column + 2 * stride), (double) (column + stride), (double) column);
+		__m256d cr = _mm256_add_pd(start, _mm256_mul_pd(step, columns));
+		__m256d zr = _mm256_setzero_pd();
+		__m256d zi = _mm256_setzero_pd();
+		__m256i counters = _mm256_setzero_si256();
+		__m256i active = _mm256_set1_epi64x(-1);
+		u_int64_t iters = 0;
+
+		if (bulbs) {
+			__m256d x = _mm256_sub_pd(cr, _mm256_set1_pd(0.25));
+			__m256d y2 = _mm256_mul_pd(ci, ci);
+			__m256d q = _mm256_add_pd(_mm256_mul_pd(x, x), y2);
+			__m256d cardioid = _mm256_cmp_pd(_mm256_mul_pd(q, _mm256_add_pd(q, x)), _mm256_mul_pd(_mm256_set1_pd(0.25), y2), _CMP_LE_OQ);
+			__m256d b = _mm256_add_pd(cr, _mm256_set1_pd(1));
+			__m256d bulb = _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(b, b), y2), _mm256_set1_pd(0.0625), _CMP_LE_OQ);
+			active = _mm256_andnot_si256(_mm256_castpd_si256(_mm256_or_pd(cardioid, bulb)), active);
+		}
+		__m256d savedR = zr;
+		__m256d savedI = zi;
+		u_int64_t power = 1;
+		u_int64_t steps = 0;
+
+		while (iters <= maxiters) {
+			__m256d zr2 = _mm256_mul_pd(zr, zr);
+			__m256d zi2 = _mm256_mul_pd(zi, zi);
+			__m256d magnitude = _mm256_add_pd(zr2, zi2);
+			__m256i escaped = _mm256_castpd_si256(_mm256_cmp_pd(magnitude, threshold, _CMP_GE_OQ));
+			active = _mm256_andnot_si256(escaped, active);
+			if (_mm256_testz_si256(active, active)) {
+				break;
+			}
+			/* active lanes hold -1, so subtracting the mask counts one more iteration for them only */
+			counters = _mm256_sub_epi64(counters, active);
+			__m256d zrzi = _mm256_mul_pd(zr, zi);
+			zr = _mm256_add_pd(_mm256_sub_pd(zr2, zi2), cr);
+			zi = _mm256_add_pd(_mm256_add_pd(zrzi, zrzi), ci);
+			iters += 1;
+			if (cycles) {
+				__m256d repeated = _mm256_and_pd(_mm256_cmp_pd(zr, savedR, _CMP_EQ_OQ), _mm256_cmp_pd(zi, savedI, _CMP_EQ_OQ));
+				__m256i cycled = _mm256_and_si256(_mm256_castpd_si256(repeated), active);
+				counters = _mm256_andnot_si256(cycled, counters);
+				active = _mm256_andnot_si256(cycled, active);
+				steps += 1;
+				if (steps == power) {
+					savedR = zr;
+					savedI = zi;
+					power *= 2;
+					steps = 0;
+				}
+			}
+		}
+		/* lanes still active never reached the threshold, which is reported as 0 */
+		counters = _mm256_andnot_si256(active, counters);
+		if (elementSize == 8) {
+			_mm256_storeu_si256((__m256i*) ((u_int64_t*) output + i), counters);
+		}
+		else {
+			u_int64_t lanes[4];
+			_mm256_storeu_si256((__m256i*) lanes, counters);
+			for (int lane = 0; lane < 4; lane++) {
+				IterationStore(output, elementSize, i + lane, lanes[lane]);
+			}
+		}
+	}
+	if (i < count) {
+		MandelbrotRowScalar(row, first + i * stride, count - i, (char*) output + i * elementSize, elementSize);
+	}
+}
+
+__attribute__((target("avx512f")))
+void MandelbrotRowAVX512(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize)
+{
+	const __m512d threshold = _mm512_set1_pd(row->thresholdSquared);
+	const __m512d start = _mm512_set1_pd(row->realStart);
+	const __m512d step = _mm512_set1_pd(row->increments);
+	const __m512d ci = _mm512_set1_pd(row->imaginary);
+	const __m512i one = _mm512_set1_epi64(1);
+	const double stride = (double) row->stride;
+	const __m512d lanes = _mm512_mul_pd(_mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0), _mm512_set1_pd(stride));
+	const int bulbs = (row->interior & MANDELBROT_INTERIOR_BULBS) && row->thresholdSquared >= 4;
+	const int cycles = row->interior & MANDELBROT_INTERIOR_CYCLES;
+	const u_int64_t maxiters = row->maxiters;
+
+	for (u_int64_t i = 0; i < count; i += 8) {
+		/* the last block of the row runs with the missing lanes masked off */
+		__mmask8 used = (count - i >= 8) ? 0xFF : (__mmask8) ((1u << (count - i)) - 1);
+		/* column numbers are far below 2^53, so adding the lane offset in double is exact */
+		__m512d columns = _mm512_add_pd(_mm512_set1_pd((double) (first + i * row->stride)), lanes);
+		__m512d cr = _mm512_add_pd(start, _mm512_mul_pd(step, columns));
+		__m512d zr = _mm512_setzero_pd();
+		__m512d zi = _mm512_setzero_pd();
+		__m512i counters = _mm512_setzero_si512();
+		__mmask8 active = used;
+		u_int64_t iters = 0;
+
+		if (bulbs) {
+			__m512d x = _mm512_sub_pd(cr, _mm512_set1_pd(0.25));
+			__m512d y2 = _mm512_mul_pd(ci, ci);
+			__m512d q = _mm512_add_pd(_mm512_mul_pd(x, x), y2);
+			__mmask8 cardioid = _mm512_cmp_pd_mask(_mm512_mul_pd(q, _mm512_add_pd(q, x)), _mm512_mul_pd(_mm512_set1_pd(0.25), y2), _CMP_LE_OQ);
+			__m512d b = _mm512_add_pd(cr, _mm512_set1_pd(1));
+			__mmask8 bulb = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_mul_pd(b, b), y2), _mm512_set1_pd(0.0625), _CMP_LE_OQ);
+			active &= (__mmask8) ~(cardioid | bulb);
+		}
+		__m512d savedR = zr;
+		__m512d savedI = zi;
+		u_int64_t power = 1;
+		u_int64_t steps = 0;
+
+		while (iters <= maxiters) {
+			__m512d zr2 = _mm512_mul_pd(zr, zr);
+			__m512d zi2 = _mm512_mul_pd(zi, zi);
+			__m512d magnitude = _mm512_add_pd(zr2, zi2);
+			active &= (__mmask8) ~_mm512_cmp_pd_mask(magnitude, threshold, _CMP_GE_OQ);
+			if (active == 0) {
+				break;
+			}
+			counters = _mm512_mask_add_epi64(counters, active, counters, one);
+			__m512d zrzi = _mm512_mul_pd(zr, zi);
+			zr = _mm512_add_pd(_mm512_sub_pd(zr2, zi2), cr);
+			zi = _mm512_add_pd(_mm512_add_pd(zrzi, zrzi), ci);
+			iters += 1;
+			if (cycles) {
+				__mmask8 cycled = _mm512_mask_cmp_pd_mask(active, zr, savedR, _CMP_EQ_OQ) & _mm512_cmp_pd_mask(zi, savedI, _CMP_EQ_OQ);
+				counters = _mm512_mask_mov_epi64(counters, cycled, _mm512_setzero_si512());
+				active &= (__mmask8) ~cycled;
+				steps += 1;
+				if (steps == power) {
+					savedR = zr;
+					savedI = zi;
+					power *= 2;
+					steps = 0;
+				}
+			}
+		}
+		counters = _mm512_maskz_mov_epi64((__mmask8) ~active, counters);
+		/* narrow the 64-bit lane counters on the way out */
+		if (elementSize == 2) {
+			_mm512_mask_cvtepi64_storeu_epi16((uint16_t*) output + i, used, counters);
+		}
+		else if (elementSize == 4) {
+			_mm512_mask_cvtepi64_storeu_epi32((uint32_t*) output + i, used, counters);
+		}
+		else {
+			_mm512_mask_storeu_epi64((u_int64_t*) output + i, used, counters);
+		}
+	}
+}
+
+int MandelbrotSIMDSupported(const char* name)
+{
+	__builtin_cpu_init();
+	if (strcmp(name, "avx2") == 0) {
+		return __builtin_cpu_supports("avx2");
+	}
+	if (strcmp(name, "avx512") == 0) {
+		return __builtin_cpu_supports("avx512f");
+	}
+	return 0;
+}
+
+#else
+
+void MandelbrotRowAVX2(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize)
+{
+	MandelbrotRowScalar(row, first, count, output, elementSize);
+}
+
+void MandelbrotRowAVX512(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize)
+{
+	MandelbrotRowScalar(row, first, count, output, elementSize);
+}
+
+int MandelbrotSIMDSupported(const char* name)
+{
+	return 0;
+}
+
+#endif
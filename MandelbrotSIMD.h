@@ -0,0 +1,27 @@
+/*********************
+**  Mandelbrot fractal, vectorized row kernels
+**  AVX2 (4 lanes) and AVX-512 (8 lanes) versions of MandelbrotRowScalar.
+**********************/
+
+#ifndef MANDELBROTSIMD_H
+#define MANDELBROTSIMD_H
+
+#include <sys/types.h>
+#include "Mandelbrot.h"
+
+/*
+Both kernels iterate a block of adjacent pixels of one row in lockstep. Every lane keeps its own
+iteration counter and escape mask, and the block stops as soon as every lane has escaped.
+They use the same operation order as MandelbrotIterationsValue and no fused multiply-add,
+so each pixel comes out identical to the scalar kernel. Counts are stored at the width given by elementSize.
+The interior shortcuts run per lane: lanes inside the bulbs start out finished, and the Brent cycle check
+retires lanes whose orbit repeats (all lanes of a block share one Brent schedule since they step together).
+Only call them when MandelbrotSIMDSupported says the CPU can run them.
+*/
+void MandelbrotRowAVX2(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+void MandelbrotRowAVX512(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+
+//Returns 1 if this CPU can run the kernel with the given name ("avx2" or "avx512"), 0 otherwise
+int MandelbrotSIMDSupported(const char* name);
+
+#endif
@@ -0,0 +1,200 @@
+/*********************
+**  Mandelbrot fractal, specialized row kernels
+**  MANDELBROT_AVX2_KERNEL and MANDELBROT_AVX512_KERNEL write out a whole kernel for a given squared threshold
+**  expression and unroll factor, so each instance is compiled with both known. Their arithmetic is that of
+**  MandelbrotRowAVX2 and MandelbrotRowAVX512 (see MandelbrotSIMD.c); only the loop around it changes.
+**********************/
+
+#include <string.h>
+#include "Mandelbrot.h"
+#include "MandelbrotSIMD.h"
+#include "MandelbrotSpecialized.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/*
+Both macros run the block n iterations at a time for as long as n more fit under maxiters, then finish one iteration
+at a time like the generic kernels, which also takes care of blocks that are already done. An iteration counts the
+lanes that are still active and then steps them, just like one pass of the generic loop.
+*/
+
+#define MANDELBROT_AVX2_STEP \
+	{ \
+		__m256d zr2 = _mm256_mul_pd(zr, zr); \
+		__m256d zi2 = _mm256_mul_pd(zi, zi); \
+		__m256i escaped = _mm256_castpd_si256(_mm256_cmp_pd(_mm256_add_pd(zr2, zi2), threshold, _CMP_GE_OQ)); \
+		active = _mm256_andnot_si256(escaped, active); \
+		counters = _mm256_sub_epi64(counters, active); \
+		__m256d zrzi = _mm256_mul_pd(zr, zi); \
+		zr = _mm256_add_pd(_mm256_sub_pd(zr2, zi2), cr); \
+		zi = _mm256_add_pd(_mm256_add_pd(zrzi, zrzi), ci); \
+	}
+
+#define MANDELBROT_AVX2_KERNEL(name, thresholdSquared, unroll) \
+__attribute__((target("avx2"))) \
+void name(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize) \
+{ \
+	const __m256d threshold = _mm256_set1_pd(thresholdSquared); \
+	const __m256d start = _mm256_set1_pd(row->realStart); \
+	const __m256d step = _mm256_set1_pd(row->increments); \
+	const __m256d ci = _mm256_set1_pd(row->imaginary); \
+	const u_int64_t maxiters = row->maxiters; \
+	const u_int64_t stride = row->stride; \
+	u_int64_t i = 0; \
+	for (; i + 4 <= count; i += 4) { \
+		u_int64_t column = first + i * stride; \
+		__m256d columns = _mm256_set_pd((double) (column + 3 * stride), (double) (column + 2 * stride), (double) (column + stride), (double) column); \
+		__m256d cr = _mm256_add_pd(start, _mm256_mul_pd(step, columns)); \
+		__m256d zr = _mm256_setzero_pd(); \
+		__m256d zi = _mm256_setzero_pd(); \
+		__m256i counters = _mm256_setzero_si256(); \
+		__m256i active = _mm256_set1_epi64x(-1); \
+		u_int64_t iters = 0; \
+		while (maxiters - iters >= (unroll) - 1 && !_mm256_testz_si256(active, active)) { \
+			_Pragma("GCC unroll 8") \
+			for (int k = 0; k < (unroll); k++) MANDELBROT_AVX2_STEP \
+			iters += (unroll); \
+			if (iters > maxiters) { \
+				break; \
+			} \
+		} \
+		while (iters <= maxiters) { \
+			__m256d magnitude = _mm256_add_pd(_mm256_mul_pd(zr, zr), _mm256_mul_pd(zi, zi)); \
+			active = _mm256_andnot_si256(_mm256_castpd_si256(_mm256_cmp_pd(magnitude, threshold, _CMP_GE_OQ)), active); \
+			if (_mm256_testz_si256(active, active)) { \
+				break; \
+			} \
+			MANDELBROT_AVX2_STEP \
+			iters += 1; \
+		} \
+		counters = _mm256_andnot_si256(active, counters); \
+		if (elementSize == 8) { \
+			_mm256_storeu_si256((__m256i*) ((u_int64_t*) output + i), counters); \
+		} \
+		else { \
+			u_int64_t lanes[4]; \
+			_mm256_storeu_si256((__m256i*) lanes, counters); \
+			for (int lane = 0; lane < 4; lane++) { \
+				IterationStore(output, elementSize, i + lane, lanes[lane]); \
+			} \
+		} \
+	} \
+	if (i < count) { \
+		MandelbrotRowScalar(row, first + i * stride, count - i, (char*) output + i * elementSize, elementSize); \
+	} \
+}
+
+#define MANDELBROT_AVX512_STEP \
+	{ \
+		__m512d zr2 = _mm512_mul_pd(zr, zr); \
+		__m512d zi2 = _mm512_mul_pd(zi, zi); \
+		active &= (__mmask8) ~_mm512_cmp_pd_mask(_mm512_add_pd(zr2, zi2), threshold, _CMP_GE_OQ); \
+		counters = _mm512_mask_add_epi64(counters, active, counters, one); \
+		__m512d zrzi = _mm512_mul_pd(zr, zi); \
+		zr = _mm512_add_pd(_mm512_sub_pd(zr2, zi2), cr); \
+		zi = _mm512_add_pd(_mm512_add_pd(zrzi, zrzi), ci); \
+	}
+
+#define MANDELBROT_AVX512_KERNEL(name, thresholdSquared, unroll) \
+__attribute__((target("avx512f"))) \
+void name(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize) \
+{ \
+	const __m512d threshold = _mm512_set1_pd(thresholdSquared); \
+	const __m512d start = _mm512_set1_pd(row->realStart); \
+	const __m512d step = _mm512_set1_pd(row->increments); \
+	const __m512d ci = _mm512_set1_pd(row->imaginary); \
+	const __m512i one = _mm512_set1_epi64(1); \
+	const __m512d lanes = _mm512_mul_pd(_mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0), _mm512_set1_pd((double) row->stride)); \
+	const u_int64_t maxiters = row->maxiters; \
+	for (u_int64_t i = 0; i < count; i += 8) { \
+		__mmask8 used = (count - i >= 8) ? 0xFF : (__mmask8) ((1u << (count - i)) - 1); \
+		__m512d columns = _mm512_add_pd(_mm512_set1_pd((double) (first + i * row->stride)), lanes); \
+		__m512d cr = _mm512_add_pd(start, _mm512_mul_pd(step, columns)); \
+		__m512d zr = _mm512_setzero_pd(); \
+		__m512d zi = _mm512_setzero_pd(); \
+		__m512i counters = _mm512_setzero_si512(); \
+		__mmask8 active = used; \
+		u_int64_t iters = 0; \
+		while (maxiters - iters >= (unroll) - 1 && active != 0) { \
+			_Pragma("GCC unroll 8") \
+			for (int k = 0; k < (unroll); k++) MANDELBROT_AVX512_STEP \
+			iters += (unroll); \
+			if (iters > maxiters) { \
+				break; \
+			} \
+		} \
+		while (iters <= maxiters) { \
+			__m512d magnitude = _mm512_add_pd(_mm512_mul_pd(zr, zr), _mm512_mul_pd(zi, zi)); \
+			active &= (__mmask8) ~_mm512_cmp_pd_mask(magnitude, threshold, _CMP_GE_OQ); \
+			if (active == 0) { \
+				break; \
+			} \
+			MANDELBROT_AVX512_STEP \
+			iters += 1; \
+		} \
+		counters = _mm512_maskz_mov_epi64((__mmask8) ~active, counters); \
+		if (elementSize == 2) { \
+			_mm512_mask_cvtepi64_storeu_epi16((uint16_t*) output + i, used, counters); \
+		} \
+		else if (elementSize == 4) { \
+			_mm512_mask_cvtepi64_storeu_epi32((uint32_t*) output + i, used, counters); \
+		} \
+		else { \
+			_mm512_mask_storeu_epi64((u_int64_t*) output + i, used, counters); \
+		} \
+	} \
+}
+
+MANDELBROT_AVX2_KERNEL(MandelbrotRowAVX2T2U2, 4.0, 2)
+MANDELBROT_AVX2_KERNEL(MandelbrotRowAVX2T2U4, 4.0, 4)
+MANDELBROT_AVX2_KERNEL(MandelbrotRowAVX2T2U8, 4.0, 8)
+MANDELBROT_AVX2_KERNEL(MandelbrotRowAVX2U4, row->thresholdSquared, 4)
+MANDELBROT_AVX512_KERNEL(MandelbrotRowAVX512T2U2, 4.0, 2)
+MANDELBROT_AVX512_KERNEL(MandelbrotRowAVX512T2U4, 4.0, 4)
+MANDELBROT_AVX512_KERNEL(MandelbrotRowAVX512T2U8, 4.0, 8)
+MANDELBROT_AVX512_KERNEL(MandelbrotRowAVX512U4, row->thresholdSquared, 4)
+
+#else
+
+#define MANDELBROT_FALLBACK_KERNEL(name) \
+void name(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize) \
+{ \
+	MandelbrotRowScalar(row, first, count, output, elementSize); \
+}
+
+MANDELBROT_FALLBACK_KERNEL(MandelbrotRowAVX2T2U2)
+MANDELBROT_FALLBACK_KERNEL(MandelbrotRowAVX2T2U4)
+MANDELBROT_FALLBACK_KERNEL(MandelbrotRowAVX2T2U8)
+MANDELBROT_FALLBACK_KERNEL(MandelbrotRowAVX2U4)
+MANDELBROT_FALLBACK_KERNEL(MandelbrotRowAVX512T2U2)
+MANDELBROT_FALLBACK_KERNEL(MandelbrotRowAVX512T2U4)
+MANDELBROT_FALLBACK_KERNEL(MandelbrotRowAVX512T2U8)
+MANDELBROT_FALLBACK_KERNEL(MandelbrotRowAVX512U4)
+
+#endif
+
+#if MANDELBROT_UNROLL == 2
+#define MANDELBROT_AVX2_T2 MandelbrotRowAVX2T2U2
+#define MANDELBROT_AVX512_T2 MandelbrotRowAVX512T2U2
+#elif MANDELBROT_UNROLL == 8
+#define MANDELBROT_AVX2_T2 MandelbrotRowAVX2T2U8
+#define MANDELBROT_AVX512_T2 MandelbrotRowAVX512T2U8
+#else
+#define MANDELBROT_AVX2_T2 MandelbrotRowAVX2T2U4
+#define MANDELBROT_AVX512_T2 MandelbrotRowAVX512T2U4
+#endif
+
+MandelbrotRowKernel MandelbrotSpecializedKernel(MandelbrotRowKernel kernel, const MandelbrotRow* row)
+{
+	if (row->interior) {
+		return kernel;
+	}
+	if (kernel == MandelbrotRowAVX2) {
+		return row->thresholdSquared == 4 ? MANDELBROT_AVX2_T2 : MandelbrotRowAVX2U4;
+	}
+	if (kernel == MandelbrotRowAVX512) {
+		return row->thresholdSquared == 4 ? MANDELBROT_AVX512_T2 : MandelbrotRowAVX512U4;
+	}
+	return kernel;
+}
@@ -0,0 +1,45 @@
+/*********************
+**  Mandelbrot fractal, specialized row kernels
+**  AVX2 and AVX-512 row kernels generated at compile time, one macro per instruction set, each for a fixed
+**  escape test and a fixed unroll factor:
+**      MandelbrotRow<set>T2U<n>   threshold 2, so the escape test is |z|^2 >= 4 against a constant
+**      MandelbrotRow<set>U<n>     any threshold, read from the row
+**  where n is the number of iterations run between two checks of whether the whole block has escaped.
+**********************/
+
+#ifndef MANDELBROTSPECIALIZED_H
+#define MANDELBROTSPECIALIZED_H
+
+#include <sys/types.h>
+#include "Mandelbrot.h"
+
+/*
+These kernels run the loop of MandelbrotRowAVX2 and MandelbrotRowAVX512, but n iterations at a time: every lane
+still takes the escape test and counts on each iteration, and only the branch that ends the block and the
+max_iterations check happen once per n iterations. Lanes that escaped within those n keep iterating, masked out
+of the counters, so every pixel comes out identical to the scalar kernel. The interior shortcuts are not used.
+The T2 kernels must only be given rows whose thresholdSquared is 4 (ComplexAbsSquaredThreshold(2)).
+Only call them when MandelbrotSIMDSupported says the CPU can run them.
+*/
+void MandelbrotRowAVX2T2U2(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+void MandelbrotRowAVX2T2U4(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+void MandelbrotRowAVX2T2U8(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+void MandelbrotRowAVX2U4(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+void MandelbrotRowAVX512T2U2(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+void MandelbrotRowAVX512T2U4(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+void MandelbrotRowAVX512T2U8(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+void MandelbrotRowAVX512U4(const MandelbrotRow* row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+
+//Unroll factor of the kernels MandelbrotSpecializedKernel picks for threshold 2: 2, 4 or 8 (make UNROLL=n)
+#ifndef MANDELBROT_UNROLL
+#define MANDELBROT_UNROLL 4
+#endif
+
+/*
+Returns the specialized kernel for rows like row on the same instruction set as kernel, or kernel itself when there
+is none: only MandelbrotRowAVX2 and MandelbrotRowAVX512 are specialized, and only for rows without interior shortcuts.
+MandelbrotRender only does this for the auto kernel; a kernel set in MandelbrotSettings.rowKernel is used as it is.
+*/
+MandelbrotRowKernel MandelbrotSpecializedKernel(MandelbrotRowKernel kernel, const MandelbrotRow* row);
+
+#endif
@@ -0,0 +1,329 @@
+/*********************
+**  PPM output
+**  Every file is a list of iovecs: the header, then one entry per row. P6 rows point straight at the
+**  caller's pixels; P3 rows are formatted into an arena, once per distinct row. The list is flushed with writev
+**  whenever it reaches IOV_MAX entries or the arena fills up.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "BoundedQueue.h"
+#include "PPMWriter.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+//Bytes of formatted P3 text collected before a flush
+#define PPM_ARENA_SIZE (1 << 20)
+
+//The longest P3 channel, "255" plus its separator
+#define PPM_P3_CHANNEL 4
+
+int PPMWriteAll(int fd, struct iovec* iov, int count)
+{
+	while (count > 0) {
+		ssize_t written = writev(fd, iov, count);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 1;
+		}
+		while (count > 0 && (size_t) written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char*) iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	return 0;
+}
+
+//Pending output of one file
+typedef struct PPMOutput
+{
+	int fd;
+	struct iovec iov[IOV_MAX];
+	int count;
+	char* arena;
+	size_t arenaSize;
+	size_t arenaUsed;
+	int failed;
+} PPMOutput;
+
+static void outputFlush(PPMOutput* output)
+{
+	if (!output->failed && PPMWriteAll(output->fd, output->iov, output->count)) {
+		output->failed = 1;
+	}
+	output->count = 0;
+}
+
+static void outputAppend(PPMOutput* output, const void* data, size_t length)
+{
+	if (output->count == IOV_MAX) {
+		outputFlush(output);
+	}
+	output->iov[output->count].iov_base = (void*) data;
+	output->iov[output->count].iov_len = length;
+	output->count++;
+}
+
+//Returns room for length bytes in the arena, flushing first if they don't fit; NULL if the arena can't grow that large
+static char* outputReserve(PPMOutput* output, size_t length)
+{
+	if (output->arenaUsed + length > output->arenaSize) {
+		/* once the pending rows are written, nothing points into the arena any more */
+		outputFlush(output);
+		output->arenaUsed = 0;
+		if (length > output->arenaSize) {
+			char* arena = (char*) realloc(output->arena, length);
+			if (arena == NULL) {
+				return NULL;
+			}
+			output->arena = arena;
+			output->arenaSize = length;
+		}
+	}
+	return output->arena + output->arenaUsed;
+}
+
+//The decimal text of every byte value
+typedef struct PPMDigits
+{
+	char text[3];
+	uint8_t length;
+} PPMDigits;
+
+static PPMDigits decimal[256];
+static pthread_once_t decimalOnce = PTHREAD_ONCE_INIT;
+
+static void decimalInit(void)
+{
+	for (int value = 0; value < 256; value++) {
+		char text[4];
+		decimal[value].length = (uint8_t) snprintf(text, sizeof(text), "%d", value);
+		memcpy(decimal[value].text, text, 3);
+	}
+}
+
+//Formats one row of width pixels as P3 text at output: every channel followed by a space, except the last, which ends the line
+static size_t formatP3Row(char* output, const uint8_t* pixels, u_int64_t width)
+{
+	size_t length = 0;
+	u_int64_t channels = 3 * width;
+	for (u_int64_t i = 0; i < channels; i++) {
+		const PPMDigits* digits = &decimal[pixels[i]];
+		memcpy(output + length, digits->text, 3);
+		length += digits->length;
+		output[length++] = ' ';
+	}
+	if (length > 0) {
+		output[length - 1] = '\n';
+	}
+	return length;
+}
+
+//Writes the header and the runs to fd. Returns 0 on success and 1 on failure.
+static int writeRuns(int fd, int format, u_int64_t width, const PPMRun* runs, u_int64_t runCount)
+{
+	PPMOutput* output = (PPMOutput*) malloc(sizeof(PPMOutput));
+	if (output == NULL) {
+		return 1;
+	}
+	output->fd = fd;
+	output->count = 0;
+	output->arenaSize = PPM_ARENA_SIZE;
+	output->arenaUsed = 0;
+	output->arena = (char*) malloc(output->arenaSize);
+	output->failed = output->arena == NULL;
+	if (format == PPM_P3) {
+		pthread_once(&decimalOnce, decimalInit);
+	}
+
+	u_int64_t height = 0;
+	for (u_int64_t run = 0; run < runCount; run++) {
+		height += runs[run].repeat;
+	}
+	char header[64];
+	int headerLength = snprintf(header, sizeof(header), "P%d %lu %lu 255\n", format, width, height);
+	outputAppend(output, header, headerLength);
+
+	size_t rowBytes = 3 * width;
+	for (u_int64_t run = 0; run < runCount && !output->failed; run++) {
+		const void* row = runs[run].pixels;
+		size_t length = rowBytes;
+		if (format == PPM_P3) {
+			char* text = outputReserve(output, PPM_P3_CHANNEL * rowBytes);
+			if (text == NULL) {
+				output->failed = 1;
+				break;
+			}
+			length = formatP3Row(text, runs[run].pixels, width);
+			output->arenaUsed += length;
+			row = text;
+		}
+		for (u_int64_t i = 0; i < runs[run].repeat; i++) {
+			outputAppend(output, row, length);
+		}
+	}
+	outputFlush(output);
+	int failed = output->failed;
+	free(output->arena);
+	free(output);
+	return failed;
+}
+
+int WritePPMRuns(const char* filename, int format, u_int64_t width, const PPMRun* runs, u_int64_t runCount)
+{
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		return 1;
+	}
+	int failed = writeRuns(fd, format, width, runs, runCount);
+	if (close(fd) != 0) {
+		failed = 1;
+	}
+	return failed;
+}
+
+//Pixel rows handed to writev at once for an image whose rows are all different
+#define PPM_ROWS_PER_RUN 256
+
+int WritePPM(const char* filename, int format, u_int64_t width, u_int64_t height, const uint8_t* pixels)
+{
+	if (format == PPM_P6) {
+		/* a P6 image is one contiguous block, so header and pixels go out in a single writev */
+		int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (fd < 0) {
+			return 1;
+		}
+		char header[64];
+		int headerLength = snprintf(header, sizeof(header), "P6 %lu %lu 255\n", width, height);
+		struct iovec iov[2] = {{header, (size_t) headerLength}, {(void*) pixels, 3 * width * height}};
+		int failed = PPMWriteAll(fd, iov, 2);
+		if (close(fd) != 0) {
+			failed = 1;
+		}
+		return failed;
+	}
+	PPMRun* runs = (PPMRun*) malloc((height > 0 ? height : 1) * sizeof(PPMRun));
+	if (runs == NULL) {
+		return 1;
+	}
+	for (u_int64_t row = 0; row < height; row++) {
+		runs[row].pixels = pixels + 3 * width * row;
+		runs[row].repeat = 1;
+	}
+	int failed = WritePPMRuns(filename, format, width, runs, height);
+	free(runs);
+	return failed;
+}
+
+//An image waiting for the writer thread, with its own copy of every row
+typedef struct PPMJob
+{
+	char* filename;
+	int format;
+	u_int64_t width;
+	PPMRun* runs;
+	u_int64_t runCount;
+	uint8_t* pixels;
+} PPMJob;
+
+struct PPMWriter
+{
+	BoundedQueue* jobs;
+	pthread_t thread;
+	int failed;
+};
+
+static void freeJob(PPMJob* job)
+{
+	free(job->filename);
+	free(job->runs);
+	free(job->pixels);
+	free(job);
+}
+
+static void* writerThread(void* arg)
+{
+	PPMWriter* writer = (PPMWriter*) arg;
+	PPMJob* job;
+	while ((job = (PPMJob*) BoundedQueuePop(writer->jobs)) != NULL) {
+		if (WritePPMRuns(job->filename, job->format, job->width, job->runs, job->runCount)) {
+			printf("Unable to write %s\n", job->filename);
+			writer->failed = 1;
+		}
+		freeJob(job);
+	}
+	return NULL;
+}
+
+PPMWriter* newPPMWriter(int depth)
+{
+	PPMWriter* writer = (PPMWriter*) malloc(sizeof(PPMWriter));
+	if (writer == NULL) {
+		return NULL;
+	}
+	writer->failed = 0;
+	writer->jobs = newBoundedQueue(depth > 0 ? depth : 1);
+	if (writer->jobs == NULL || pthread_create(&writer->thread, NULL, writerThread, writer) != 0) {
+		freeBoundedQueue(writer->jobs);
+		free(writer);
+		return NULL;
+	}
+	return writer;
+}
+
+int PPMWriterSubmitRuns(PPMWriter* writer, const char* filename, int format, u_int64_t width, const PPMRun* runs, u_int64_t runCount)
+{
+	PPMJob* job = (PPMJob*) calloc(1, sizeof(PPMJob));
+	if (job == NULL) {
+		return 1;
+	}
+	job->filename = strdup(filename);
+	job->format = format;
+	job->width = width;
+	job->runCount = runCount;
+	job->runs = (PPMRun*) malloc((runCount > 0 ? runCount : 1) * sizeof(PPMRun));
+	job->pixels = (uint8_t*) malloc((runCount > 0 ? runCount : 1) * 3 * width);
+	if (job->filename == NULL || job->runs == NULL || job->pixels == NULL) {
+		freeJob(job);
+		return 1;
+	}
+	for (u_int64_t run = 0; run < runCount; run++) {
+		memcpy(job->pixels + 3 * width * run, runs[run].pixels, 3 * width);
+		job->runs[run].pixels = job->pixels + 3 * width * run;
+		job->runs[run].repeat = runs[run].repeat;
+	}
+	if (BoundedQueuePush(writer->jobs, job)) {
+		freeJob(job);
+		return 1;
+	}
+	return 0;
+}
+
+int freePPMWriter(PPMWriter* writer)
+{
+	if (writer == NULL) {
+		return 0;
+	}
+	BoundedQueueClose(writer->jobs);
+	pthread_join(writer->thread, NULL);
+	int failed = writer->failed;
+	freeBoundedQueue(writer->jobs);
+	free(writer);
+	return failed;
+}
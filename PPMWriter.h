@@ -0,0 +1,50 @@
+/*********************
+**  PPM output
+**  One writer for every .ppm file the programs produce. Headers are "P3 <width> <height> 255\n" or
+**  "P6 <width> <height> 255\n"; P3 channels are separated by spaces with a newline after each row.
+**  Files go out through writev in large pieces: rows that repeat are formatted once and handed to the
+**  kernel as many times as they appear, and P3 numbers come from a table instead of printf.
+**********************/
+
+#ifndef PPMWRITER_H
+#define PPMWRITER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define PPM_P3 3
+#define PPM_P6 6
+
+//repeat identical rows of pixels, 3 bytes per pixel
+typedef struct PPMRun
+{
+	const uint8_t* pixels;
+	u_int64_t repeat;
+} PPMRun;
+
+//Writes a P3 or P6 image of width x height pixels, stored row by row, to filename. Returns 0 on success and 1 on failure.
+int WritePPM(const char* filename, int format, u_int64_t width, u_int64_t height, const uint8_t* pixels);
+
+//Writes a P3 or P6 image made of runCount runs of identical rows to filename. Returns 0 on success and 1 on failure.
+int WritePPMRuns(const char* filename, int format, u_int64_t width, const PPMRun* runs, u_int64_t runCount);
+
+//Writes all of iov[0..count-1] to fd, picking up after partial writes. Returns 0 on success and 1 on failure.
+int PPMWriteAll(int fd, struct iovec* iov, int count);
+
+/*
+A background I/O thread. Submitted images are copied, so the caller can reuse its buffers right away,
+and are written in submission order while the caller moves on.
+*/
+typedef struct PPMWriter PPMWriter;
+
+//Starts a writer that holds at most depth images waiting to be written. Returns NULL on failure.
+PPMWriter* newPPMWriter(int depth);
+
+//Queues WritePPMRuns(filename, format, width, runs, runCount). Returns 0 if it was queued and 1 otherwise.
+int PPMWriterSubmitRuns(PPMWriter* writer, const char* filename, int format, u_int64_t width, const PPMRun* runs, u_int64_t runCount);
+
+//Waits for every queued image, stops the thread and frees the writer. Returns 0 if every write succeeded and 1 otherwise.
+int freePPMWriter(PPMWriter* writer);
+
+#endif
@@ -0,0 +1,190 @@
+/*********************
+**  Palettes
+**  The lookup table makes colorizing one load and one store per pixel. Consecutive pixels are 3 bytes apart,
+**  so each one is written as a 4-byte word whose last byte the next pixel overwrites.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "IterationMap.h"
+#include "Palette.h"
+
+Palette* newPalette(uint8_t** colorMap, int colorcount)
+{
+	Palette* palette = (Palette*) malloc(sizeof(Palette));
+	if (palette == NULL) {
+		return NULL;
+	}
+	palette->colorcount = colorcount;
+	palette->colors = (uint8_t*) malloc(3 * (size_t) colorcount);
+	if (palette->colors == NULL) {
+		free(palette);
+		return NULL;
+	}
+	for (int i = 0; i < colorcount; i++) {
+		memcpy(palette->colors + 3 * i, colorMap[i], 3);
+	}
+	return palette;
+}
+
+void freePalette(Palette* palette)
+{
+	if (palette == NULL) {
+		return;
+	}
+	free(palette->colors);
+	free(palette);
+}
+
+//The color of count by the original formula, including its u_int64_t wrap-around when count is a multiple of colorcount
+static const uint8_t* paletteLookup(const Palette* palette, u_int64_t count)
+{
+	static const uint8_t black[3] = {0, 0, 0};
+	if (count == 0) {
+		return black;
+	}
+	u_int64_t colorcount = (u_int64_t) palette->colorcount;
+	int indexer = ((count % colorcount) - 1) % colorcount;
+	return palette->colors + 3 * indexer;
+}
+
+PaletteTable* newPaletteTable(const Palette* palette, u_int64_t max_iterations)
+{
+	PaletteTable* table = (PaletteTable*) malloc(sizeof(PaletteTable));
+	if (table == NULL) {
+		return NULL;
+	}
+	table->palette = palette;
+	table->length = max_iterations < PALETTE_TABLE_LIMIT ? max_iterations + 1 : PALETTE_TABLE_LIMIT;
+	table->rgbx = (uint8_t*) malloc(4 * table->length);
+	if (table->rgbx == NULL) {
+		free(table);
+		return NULL;
+	}
+	for (u_int64_t count = 0; count < table->length; count++) {
+		memcpy(table->rgbx + 4 * count, paletteLookup(palette, count), 3);
+		table->rgbx[4 * count + 3] = 0;
+	}
+	return table;
+}
+
+void freePaletteTable(PaletteTable* table)
+{
+	if (table == NULL) {
+		return;
+	}
+	free(table->rgbx);
+	free(table);
+}
+
+void PaletteColor(const PaletteTable* table, u_int64_t count, uint8_t* rgb)
+{
+	memcpy(rgb, count < table->length ? table->rgbx + 4 * count : paletteLookup(table->palette, count), 3);
+}
+
+/*
+The scalar kernel, written once per element width so the inner loop is just load, index, store.
+Every pixel but the last is stored as 4 bytes; the extra byte lands on the next pixel, which overwrites it.
+*/
+#define PALETTE_COLORIZE_LOOP(type) \
+	do { \
+		const type* values = (const type*) counts; \
+		for (; i + 1 < count; i++) { \
+			u_int64_t value = values[i]; \
+			if (value >= table->length) { \
+				PaletteColor(table, value, rgb + 3 * i); \
+				continue; \
+			} \
+			memcpy(rgb + 3 * i, rgbx + 4 * value, 4); \
+		} \
+		if (i < count) { \
+			PaletteColor(table, values[i], rgb + 3 * i); \
+		} \
+	} while (0)
+
+static void paletteColorizeScalar(const PaletteTable* table, const void* counts, int elementSize, u_int64_t i, u_int64_t count, uint8_t* rgb)
+{
+	const uint8_t* rgbx = table->rgbx;
+	switch (elementSize) {
+	case 2:
+		PALETTE_COLORIZE_LOOP(uint16_t);
+		break;
+	case 4:
+		PALETTE_COLORIZE_LOOP(uint32_t);
+		break;
+	default:
+		PALETTE_COLORIZE_LOOP(u_int64_t);
+		break;
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/*
+Eight pixels at a time: widen the counts to 32 bits, gather their table entries, squeeze out the padding byte
+of each entry inside both 128-bit halves, and store the two 12-byte halves 12 bytes apart.
+Each half is stored as 16 bytes, so the loop stops while at least 2 pixels are left for the scalar tail to finish.
+It also stops at the first block holding a count past the table, which the scalar loop knows how to handle.
+Returns the number of pixels done.
+*/
+__attribute__((target("avx2")))
+static u_int64_t paletteColorizeAVX2(const PaletteTable* table, const void* counts, int elementSize, u_int64_t count, uint8_t* rgb)
+{
+	const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	const __m256i last = _mm256_set1_epi32((int) (table->length - 1));
+	u_int64_t i = 0;
+	for (; i + 10 <= count; i += 8) {
+		__m256i values;
+		if (elementSize == 2) {
+			values = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) ((const uint16_t*) counts + i)));
+		}
+		else {
+			values = _mm256_loadu_si256((const __m256i*) ((const uint32_t*) counts + i));
+		}
+		__m256i inside = _mm256_cmpeq_epi32(_mm256_max_epu32(values, last), last);
+		if (_mm256_movemask_epi8(inside) != -1) {
+			break;
+		}
+		__m256i colors = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int*) table->rgbx, values, 4), pack);
+		_mm_storeu_si128((__m128i*) (rgb + 3 * i), _mm256_castsi256_si128(colors));
+		_mm_storeu_si128((__m128i*) (rgb + 3 * i + 12), _mm256_extracti128_si256(colors, 1));
+	}
+	return i;
+}
+
+static int paletteHasAVX2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+static u_int64_t paletteColorizeAVX2(const PaletteTable* table, const void* counts, int elementSize, u_int64_t count, uint8_t* rgb)
+{
+	return 0;
+}
+
+static int paletteHasAVX2(void)
+{
+	return 0;
+}
+
+#endif
+
+void PaletteColorize(const PaletteTable* table, const void* counts, int elementSize, u_int64_t count, uint8_t* rgb)
+{
+	u_int64_t done = 0;
+	if (elementSize <= 4 && paletteHasAVX2()) {
+		done = paletteColorizeAVX2(table, counts, elementSize, count, rgb);
+	}
+	paletteColorizeScalar(table, counts, elementSize, done, count, rgb);
+}
+
+void PaletteColorizeMap(const PaletteTable* table, const IterationMap* map, uint8_t* rgb)
+{
+	PaletteColorize(table, map->data, map->elementSize, map->size * map->size, rgb);
+}
@@ -0,0 +1,60 @@
+/*********************
+**  Palettes
+**  A color map stored as one contiguous array, and a lookup table that turns iteration counts
+**  straight into RGB without a modulo, a pointer chase or a branch per pixel.
+**********************/
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "IterationMap.h"
+
+//colorcount colors, color i in colors[3*i], colors[3*i+1] and colors[3*i+2]
+typedef struct Palette
+{
+	int colorcount;
+	uint8_t* colors;
+} Palette;
+
+//Returns a new palette holding a copy of the colorcount colors of colorMap (as returned by FileToColorMap), or NULL on failure
+Palette* newPalette(uint8_t** colorMap, int colorcount);
+
+//Frees the palette
+void freePalette(Palette* palette);
+
+/*
+The color of every count from 0 to max_iterations. Count 0 (never escaped) is black, and every other count c
+gets color (((c % colorcount) - 1) % colorcount), computed in u_int64_t exactly like MandelMovie always has.
+Each entry is padded to 4 bytes so it can be copied or gathered as one 32-bit word.
+Tables are capped at PALETTE_TABLE_LIMIT entries; larger counts are looked up the slow way.
+*/
+typedef struct PaletteTable
+{
+	u_int64_t length;     //Entries in rgbx, covering counts 0..length-1
+	uint8_t* rgbx;        //length * 4 bytes: red, green, blue, 0
+	const Palette* palette;
+} PaletteTable;
+
+#define PALETTE_TABLE_LIMIT (1u << 24)
+
+//Returns a new table for counts up to max_iterations, or NULL on failure. palette must outlive the table.
+PaletteTable* newPaletteTable(const Palette* palette, u_int64_t max_iterations);
+
+//Frees the table
+void freePaletteTable(PaletteTable* table);
+
+//Writes the 3-byte color of count at rgb
+void PaletteColor(const PaletteTable* table, u_int64_t count, uint8_t* rgb);
+
+/*
+Writes the colors of the count counts in the elementSize-byte array counts to rgb, 3 bytes per count.
+Uses an AVX2 gather when the CPU has it.
+*/
+void PaletteColorize(const PaletteTable* table, const void* counts, int elementSize, u_int64_t count, uint8_t* rgb);
+
+//PaletteColorize on every pixel of map, row by row
+void PaletteColorizeMap(const PaletteTable* table, const IterationMap* map, uint8_t* rgb);
+
+#endif
@@ -0,0 +1,264 @@
+/*********************
+**  Perturbation rendering for deep zooms
+**  One double-double reference orbit per center, double-precision deltas per pixel,
+**  rebasing to avoid glitches, and an optional cubic series approximation to skip the first iterations.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "ComplexNumber.h"
+#include "IterationMap.h"
+#include "Perturbation.h"
+
+/*
+Double-double numbers: value = high + low with |low| <= ulp(high)/2, good for about 106 bits.
+The error-free transformations below need every product rounded on its own, which the Makefile's
+-ffp-contract=off guarantees.
+*/
+typedef struct DoubleDouble
+{
+	double high;
+	double low;
+} DoubleDouble;
+
+static DoubleDouble quickTwoSum(double a, double b)
+{
+	DoubleDouble result;
+	result.high = a + b;
+	result.low = b - (result.high - a);
+	return result;
+}
+
+static DoubleDouble twoSum(double a, double b)
+{
+	DoubleDouble result;
+	result.high = a + b;
+	double bb = result.high - a;
+	result.low = (a - (result.high - bb)) + (b - bb);
+	return result;
+}
+
+static DoubleDouble twoProduct(double a, double b)
+{
+	const double splitter = 134217729.0; /* 2^27 + 1 */
+	double t = splitter * a;
+	double aHigh = t - (t - a);
+	double aLow = a - aHigh;
+	t = splitter * b;
+	double bHigh = t - (t - b);
+	double bLow = b - bHigh;
+	DoubleDouble result;
+	result.high = a * b;
+	result.low = (((aHigh * bHigh - result.high) + aHigh * bLow) + aLow * bHigh) + aLow * bLow;
+	return result;
+}
+
+static DoubleDouble ddAdd(DoubleDouble a, DoubleDouble b)
+{
+	DoubleDouble s = twoSum(a.high, b.high);
+	DoubleDouble t = twoSum(a.low, b.low);
+	s.low += t.high;
+	s = quickTwoSum(s.high, s.low);
+	s.low += t.low;
+	return quickTwoSum(s.high, s.low);
+}
+
+static DoubleDouble ddNegate(DoubleDouble a)
+{
+	a.high = -a.high;
+	a.low = -a.low;
+	return a;
+}
+
+static DoubleDouble ddMultiply(DoubleDouble a, DoubleDouble b)
+{
+	DoubleDouble p = twoProduct(a.high, b.high);
+	p.low += (a.high * b.low) + (a.low * b.high);
+	return quickTwoSum(p.high, p.low);
+}
+
+static DoubleDouble ddFromDouble(double a)
+{
+	DoubleDouble result = {a, 0};
+	return result;
+}
+
+struct PerturbationOrbit
+{
+	double centerReal;
+	double centerImaginary;
+	u_int64_t maxiters;
+	double threshold;
+	double thresholdSquared;
+	u_int64_t length;       //Number of stored reference values, at least 2
+	ComplexValue* reference; //Z_0 .. Z_{length-1}, rounded to double
+	double* magnitude;       //|Z_n|, used to bound the series skip
+	ComplexValue* seriesA;   //delta_n ~= A_n dc + B_n dc^2 + C_n dc^3
+	ComplexValue* seriesB;
+	ComplexValue* seriesC;
+};
+
+PerturbationOrbit* newPerturbationOrbit(ComplexNumber* center, u_int64_t max_iterations, double threshold)
+{
+	PerturbationOrbit* orbit = (PerturbationOrbit*) calloc(1, sizeof(PerturbationOrbit));
+	if (orbit == NULL) {
+		return NULL;
+	}
+	orbit->centerReal = Re(center);
+	orbit->centerImaginary = Im(center);
+	orbit->maxiters = max_iterations;
+	orbit->threshold = threshold;
+	orbit->thresholdSquared = ComplexAbsSquaredThreshold(threshold);
+
+	/* the orbit is stored up to and including its first escaping value, and never past max_iterations + 1 */
+	u_int64_t capacity = max_iterations + 2;
+	orbit->reference = (ComplexValue*) malloc(capacity * sizeof(ComplexValue));
+	orbit->magnitude = (double*) malloc(capacity * sizeof(double));
+	orbit->seriesA = (ComplexValue*) malloc(capacity * sizeof(ComplexValue));
+	orbit->seriesB = (ComplexValue*) malloc(capacity * sizeof(ComplexValue));
+	orbit->seriesC = (ComplexValue*) malloc(capacity * sizeof(ComplexValue));
+	if (orbit->reference == NULL || orbit->magnitude == NULL || orbit->seriesA == NULL || orbit->seriesB == NULL || orbit->seriesC == NULL) {
+		freePerturbationOrbit(orbit);
+		return NULL;
+	}
+
+	DoubleDouble cr = ddFromDouble(orbit->centerReal);
+	DoubleDouble ci = ddFromDouble(orbit->centerImaginary);
+	DoubleDouble zr = ddFromDouble(0);
+	DoubleDouble zi = ddFromDouble(0);
+	ComplexValue zero = ComplexValueOf(0, 0);
+	ComplexValue one = ComplexValueOf(1, 0);
+	ComplexValue a = zero;
+	ComplexValue b = zero;
+	ComplexValue c = zero;
+	u_int64_t n = 0;
+	for (;;) {
+		ComplexValue z = ComplexValueOf(zr.high, zi.high);
+		orbit->reference[n] = z;
+		orbit->magnitude[n] = sqrt(ComplexValueAbsSquared(z));
+		orbit->seriesA[n] = a;
+		orbit->seriesB[n] = b;
+		orbit->seriesC[n] = c;
+		n += 1;
+		if (n == capacity || (n >= 2 && ComplexValueAbsSquared(z) >= orbit->thresholdSquared)) {
+			break;
+		}
+		/* A_{n+1} = 2 Z_n A_n + 1,  B_{n+1} = 2 Z_n B_n + A_n^2,  C_{n+1} = 2 Z_n C_n + 2 A_n B_n */
+		ComplexValue twoZ = ComplexValueOf(2 * z.real, 2 * z.imaginary);
+		ComplexValue ab = ComplexValueProduct(a, b);
+		ComplexValue nextC = ComplexValueSum(ComplexValueProduct(twoZ, c), ComplexValueOf(2 * ab.real, 2 * ab.imaginary));
+		ComplexValue nextB = ComplexValueSum(ComplexValueProduct(twoZ, b), ComplexValueProduct(a, a));
+		a = ComplexValueSum(ComplexValueProduct(twoZ, a), one);
+		b = nextB;
+		c = nextC;
+
+		DoubleDouble zr2 = ddMultiply(zr, zr);
+		DoubleDouble zi2 = ddMultiply(zi, zi);
+		DoubleDouble zrzi = ddMultiply(zr, zi);
+		zr = ddAdd(ddAdd(zr2, ddNegate(zi2)), cr);
+		zi = ddAdd(ddAdd(zrzi, zrzi), ci);
+	}
+	orbit->length = n;
+	return orbit;
+}
+
+void freePerturbationOrbit(PerturbationOrbit* orbit)
+{
+	if (orbit == NULL) {
+		return;
+	}
+	free(orbit->reference);
+	free(orbit->magnitude);
+	free(orbit->seriesA);
+	free(orbit->seriesB);
+	free(orbit->seriesC);
+	free(orbit);
+}
+
+int PerturbationOrbitMatches(const PerturbationOrbit* orbit, ComplexNumber* center, u_int64_t max_iterations, double threshold)
+{
+	return orbit->centerReal == Re(center) && orbit->centerImaginary == Im(center)
+		&& orbit->maxiters == max_iterations && orbit->threshold == threshold;
+}
+
+/*
+The series is trusted while its cubic term stays below 2^-32 of its linear term over the whole frame, which
+keeps the truncation error far below a pixel. Skipping also stops before the first iteration where
+|Z_n| plus the largest possible |delta_n| could reach the threshold, so no pixel can escape unseen.
+*/
+#define PERTURBATION_SERIES_TOLERANCE 2.3283064365386963e-10
+
+void PerturbationFrameInit(PerturbationFrame* frame, const PerturbationOrbit* orbit, double scale, u_int64_t resolution, int series)
+{
+	frame->orbit = orbit;
+	frame->resolution = resolution;
+	frame->increments = resolution > 0 ? scale / resolution : 0;
+	frame->skip = 0;
+	if (!series || resolution == 0) {
+		return;
+	}
+	double radius = scale * sqrt(2);
+	double escape = sqrt(orbit->thresholdSquared);
+	u_int64_t last = orbit->length - 1;
+	if (last > orbit->maxiters) {
+		last = orbit->maxiters;
+	}
+	for (u_int64_t n = 1; n < last; n++) {
+		double linear = sqrt(ComplexValueAbsSquared(orbit->seriesA[n])) * radius;
+		double quadratic = sqrt(ComplexValueAbsSquared(orbit->seriesB[n])) * radius * radius;
+		double cubic = sqrt(ComplexValueAbsSquared(orbit->seriesC[n])) * radius * radius * radius;
+		if (!(cubic <= PERTURBATION_SERIES_TOLERANCE * linear) || !(orbit->magnitude[n] + linear + quadratic + cubic < escape)) {
+			break;
+		}
+		frame->skip = n;
+	}
+}
+
+/*
+Per-pixel loop. z_n = Z_m + delta is checked against the threshold exactly like the plain loop.
+When |z_n| drops below |delta|, or the reference orbit runs out (the center escaped first), delta is rebased:
+it becomes z_n itself and the reference index restarts at Z_0 = 0. This is the glitch detection: a pixel whose
+orbit has drifted away from the reference would otherwise lose its precision in the cancellation of Z_m + delta.
+*/
+u_int64_t PerturbationIterations(const PerturbationFrame* frame, ComplexValue deltaC)
+{
+	const PerturbationOrbit* orbit = frame->orbit;
+	const ComplexValue* reference = orbit->reference;
+	u_int64_t m = frame->skip;
+	u_int64_t iters = frame->skip;
+	ComplexValue delta = ComplexValueOf(0, 0);
+	if (m > 0) {
+		ComplexValue dc2 = ComplexValueProduct(deltaC, deltaC);
+		ComplexValue dc3 = ComplexValueProduct(dc2, deltaC);
+		delta = ComplexValueSum(ComplexValueSum(ComplexValueProduct(orbit->seriesA[m], deltaC), ComplexValueProduct(orbit->seriesB[m], dc2)),
+			ComplexValueProduct(orbit->seriesC[m], dc3));
+	}
+
+	while (iters <= orbit->maxiters) {
+		ComplexValue z = ComplexValueSum(reference[m], delta);
+		double magnitude = ComplexValueAbsSquared(z);
+		if (magnitude >= orbit->thresholdSquared) {
+			return iters;
+		}
+		if (magnitude < ComplexValueAbsSquared(delta) || m + 1 == orbit->length) {
+			delta = z;
+			m = 0;
+		}
+		ComplexValue twoZ = ComplexValueOf(2 * reference[m].real, 2 * reference[m].imaginary);
+		delta = ComplexValueSum(ComplexValueProduct(ComplexValueSum(twoZ, delta), delta), deltaC);
+		m += 1;
+		iters += 1;
+	}
+	return 0;
+}
+
+void PerturbationRow(const PerturbationFrame* frame, u_int64_t row, u_int64_t first, u_int64_t count, void* output, int elementSize)
+{
+	/* offsets from the center are small integers times increments, so they keep full relative precision */
+	double imaginary = frame->increments * ((double) frame->resolution - (double) row);
+	for (u_int64_t i = 0; i < count; i++) {
+		double real = frame->increments * ((double) (first + i) - (double) frame->resolution);
+		IterationStore(output, elementSize, i, PerturbationIterations(frame, ComplexValueOf(real, imaginary)));
+	}
+}
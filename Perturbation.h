@@ -0,0 +1,55 @@
+/*********************
+**  Perturbation rendering for deep zooms
+**  Plain double precision runs out below a scale of about 1e-13: neighbouring pixels round to the same point.
+**  Here a single reference orbit Z_n is computed at the center in double-double precision (about 32 digits),
+**  and every pixel only iterates its small offset from that orbit,
+**      delta_{n+1} = (2 Z_n + delta_n) delta_n + delta_c,
+**  which stays accurate in plain doubles because delta_c is never added to a large number.
+**********************/
+
+#ifndef PERTURBATION_H
+#define PERTURBATION_H
+
+#include <sys/types.h>
+#include "ComplexNumber.h"
+
+/*
+The reference orbit for one center, threshold and max_iterations, plus the series approximation
+coefficients along it. None of it depends on the scale, so one orbit serves every frame of a zoom.
+*/
+typedef struct PerturbationOrbit PerturbationOrbit;
+
+//Computes the reference orbit of center. Returns NULL on failure.
+PerturbationOrbit* newPerturbationOrbit(ComplexNumber* center, u_int64_t max_iterations, double threshold);
+
+//Frees the orbit
+void freePerturbationOrbit(PerturbationOrbit* orbit);
+
+//Returns 1 if orbit was computed for exactly this center, max_iterations and threshold
+int PerturbationOrbitMatches(const PerturbationOrbit* orbit, ComplexNumber* center, u_int64_t max_iterations, double threshold);
+
+/*
+What one frame needs besides the orbit: the pixel spacing, and how many iterations the series approximation
+lets every pixel skip. skip is 0 when the series approximation is off.
+*/
+typedef struct PerturbationFrame
+{
+	const PerturbationOrbit* orbit;
+	double increments;
+	u_int64_t resolution;
+	u_int64_t skip;
+} PerturbationFrame;
+
+/*
+Sets up frame for the given scale and resolution. With series set, the largest skip is chosen for which
+the cubic series is still accurate over the whole frame and provably no pixel escapes during the skipped iterations.
+*/
+void PerturbationFrameInit(PerturbationFrame* frame, const PerturbationOrbit* orbit, double scale, u_int64_t resolution, int series);
+
+//Returns the iterations of the point center + deltaC, with the same meaning as MandelbrotIterations
+u_int64_t PerturbationIterations(const PerturbationFrame* frame, ComplexValue deltaC);
+
+//Fills elements 0..count-1 of output (elementSize-byte counts) with columns first..first+count-1 of the given row
+void PerturbationRow(const PerturbationFrame* frame, u_int64_t row, u_int64_t first, u_int64_t count, void* output, int elementSize);
+
+#endif
@@ -0,0 +1,128 @@
+/*********************
+**  Sharded rendering
+**  Band files are written with three fwrites and read back with one mmap, like iteration map files.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Shard.h"
+#include "Hash.h"
+
+_Static_assert(sizeof(BandFileHeader) == 128, "the counts must start at byte 128");
+
+int ParseShard(const char* text, u_int64_t* shard, u_int64_t* shards)
+{
+	unsigned long index, count;
+	char end;
+	/* %lu would take "-1" and wrap it around, so both numbers must start with a digit */
+	const char* slash = strchr(text, '/');
+	if (!isdigit((unsigned char) text[0]) || slash == NULL || !isdigit((unsigned char) slash[1])) {
+		return 1;
+	}
+	if (sscanf(text, "%lu/%lu%c", &index, &count, &end) != 2 || count == 0 || count > SHARD_MAX || index >= count) {
+		return 1;
+	}
+	*shard = index;
+	*shards = count;
+	return 0;
+}
+
+void ShardRows(u_int64_t size, u_int64_t shard, u_int64_t shards, u_int64_t* firstRow, u_int64_t* rows)
+{
+	*firstRow = size * shard / shards;
+	*rows = size * (shard + 1) / shards - *firstRow;
+}
+
+u_int64_t ShardChecksum(const void* data, u_int64_t length)
+{
+	return HashBytes(HASH_SEED, data, length);
+}
+
+int WriteBandFile(FILE* outputfile, const IterationFileHeader* frame, u_int64_t shard, u_int64_t shards, u_int64_t firstRow, u_int64_t rows, const IterationMap* band)
+{
+	size_t counts = rows * band->size;
+	BandFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.frame = *frame;
+	memcpy(header.frame.magic, BAND_FILE_MAGIC, sizeof(header.frame.magic));
+	header.shard = shard;
+	header.shards = shards;
+	header.firstRow = firstRow;
+	header.rows = rows;
+	header.checksum = ShardChecksum(band->data, counts * band->elementSize);
+	if (fwrite(&header, sizeof(header), 1, outputfile) != 1) {
+		return 1;
+	}
+	return fwrite(band->data, band->elementSize, counts, outputfile) != counts;
+}
+
+BandFile* openBandFile(const char* filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		printf("Unable to open %s\n", filename);
+		return NULL;
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0 || (size_t) status.st_size < sizeof(BandFileHeader)) {
+		printf("%s is too short to be a band file\n", filename);
+		close(fd);
+		return NULL;
+	}
+	size_t length = (size_t) status.st_size;
+	void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		printf("Unable to map %s\n", filename);
+		return NULL;
+	}
+	const BandFileHeader* header = (const BandFileHeader*) mapping;
+	if (memcmp(header->frame.magic, BAND_FILE_MAGIC, 8) != 0 || header->frame.version != ITERATION_FILE_VERSION) {
+		printf("%s is not a version %d band file\n", filename, ITERATION_FILE_VERSION);
+		munmap(mapping, length);
+		return NULL;
+	}
+	u_int64_t size = 2 * header->frame.resolution + 1;
+	u_int64_t elementSize = header->frame.elementSize;
+	if ((elementSize != 2 && elementSize != 4 && elementSize != 8)
+		|| header->frame.resolution > (1ull << 28) || header->shards == 0 || header->shards > SHARD_MAX || header->shard >= header->shards
+		|| header->firstRow + header->rows > size
+		|| length - sizeof(BandFileHeader) < header->rows * size * elementSize) {
+		printf("%s has a damaged header or is truncated\n", filename);
+		munmap(mapping, length);
+		return NULL;
+	}
+	void* counts = (char*) mapping + sizeof(BandFileHeader);
+	if (ShardChecksum(counts, header->rows * size * elementSize) != header->checksum) {
+		printf("%s does not match its checksum\n", filename);
+		munmap(mapping, length);
+		return NULL;
+	}
+	BandFile* file = (BandFile*) malloc(sizeof(BandFile));
+	if (file == NULL) {
+		munmap(mapping, length);
+		return NULL;
+	}
+	file->header = header;
+	file->band.size = size;
+	file->band.elementSize = (int) elementSize;
+	file->band.data = counts;
+	file->mapping = mapping;
+	file->length = length;
+	return file;
+}
+
+void closeBandFile(BandFile* file)
+{
+	if (file == NULL) {
+		return;
+	}
+	munmap(file->mapping, file->length);
+	free(file);
+}
@@ -0,0 +1,78 @@
+/*********************
+**  Sharded rendering
+**  One render split over N processes, which may run on different machines sharing a filesystem.
+**  A movie is split by frame: shard i renders frames i, i + N, i + 2N, ..., so every shard gets a share of the deep,
+**  slow frames at the end. A single frame is split into N bands of consecutive rows, each written to a band file,
+**  which MandelMerge puts back together.
+**
+**  A band file is a binary iteration map file (see IterationFile.h) with the magic "MANDBAND", whose header describes
+**  the whole frame, followed by a second 64-byte header and the counts of the band's rows only:
+**
+**  Offset  Size  Field
+**       0    64  IterationFileHeader of the whole frame, magic "MANDBAND"
+**      64     8  shard, from 0
+**      72     8  shards
+**      80     8  first row of the band
+**      88     8  rows in the band
+**      96     8  FNV-1a hash of the counts, which catches files cut short or overwritten
+**     104    24  reserved, 0
+**     128        counts
+**********************/
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "IterationMap.h"
+#include "IterationFile.h"
+
+#define BAND_FILE_MAGIC "MANDBAND"
+
+typedef struct BandFileHeader
+{
+	IterationFileHeader frame;
+	u_int64_t shard;
+	u_int64_t shards;
+	u_int64_t firstRow;
+	u_int64_t rows;
+	u_int64_t checksum;
+	u_int64_t reserved[3];
+} BandFileHeader;
+
+//Most shards a frame or movie can be split into
+#define SHARD_MAX 10000
+
+//Reads "i/N" into shard and shards. Returns 0 on success and 1 unless both are plain decimal numbers with 0 <= i < N <= SHARD_MAX.
+int ParseShard(const char* text, u_int64_t* shard, u_int64_t* shards);
+
+//Sets firstRow and rows to the band of shard out of shards, for a frame size rows high. Bands differ by at most one row.
+void ShardRows(u_int64_t size, u_int64_t shard, u_int64_t shards, u_int64_t* firstRow, u_int64_t* rows);
+
+//Returns the FNV-1a hash of length bytes
+u_int64_t ShardChecksum(const void* data, u_int64_t length);
+
+/*
+Writes band, the rows of a frame described by frame, to outputfile as a band file.
+Returns 0 on success and 1 if the file could not be written.
+*/
+int WriteBandFile(FILE* outputfile, const IterationFileHeader* frame, u_int64_t shard, u_int64_t shards, u_int64_t firstRow, u_int64_t rows, const IterationMap* band);
+
+/*
+A band file mapped into memory. band.data points into the mapping, which is read only, and holds header->rows rows.
+*/
+typedef struct BandFile
+{
+	const BandFileHeader* header;
+	IterationMap band;
+	void* mapping;
+	size_t length;
+} BandFile;
+
+//Maps filename into memory and checks its header and checksum. Prints what is wrong and returns NULL if it is not a valid file.
+BandFile* openBandFile(const char* filename);
+
+//Unmaps the file and frees file
+void closeBandFile(BandFile* file);
+
+#endif
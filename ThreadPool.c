@@ -0,0 +1,220 @@
+/*********************
+**  Thread pool
+**  A fixed set of worker threads that run parallel loops over task indices.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "ThreadPool.h"
+
+/*
+A worker's deque holds the contiguous task range [top, bottom).
+The owner pops from the bottom, and thieves take from the top, so an owner keeps working on
+neighbouring tasks (neighbouring tiles) while stolen work comes from the far end of its range.
+*/
+typedef struct WorkDeque
+{
+	pthread_mutex_t lock;
+	u_int64_t top;
+	u_int64_t bottom;
+} WorkDeque;
+
+typedef struct WorkerStart
+{
+	ThreadPool* pool;
+	int index;
+} WorkerStart;
+
+struct ThreadPool
+{
+	int threads;
+	pthread_t* workers;
+	WorkerStart* starts;
+	WorkDeque* deques;
+
+	pthread_mutex_t runLock;
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	u_int64_t generation;
+	int busy;
+	int stopping;
+
+	ThreadPoolTask function;
+	void* arg;
+};
+
+static int popBottom(WorkDeque* deque, u_int64_t* task)
+{
+	int found = 0;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->top < deque->bottom) {
+		deque->bottom -= 1;
+		*task = deque->bottom;
+		found = 1;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+static int stealTop(WorkDeque* deque, u_int64_t* task)
+{
+	int found = 0;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->top < deque->bottom) {
+		*task = deque->top;
+		deque->top += 1;
+		found = 1;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+//Runs tasks until every deque is empty. Tasks are never added during a loop, so empty deques mean the loop is handed out.
+static void work(ThreadPool* pool, int index)
+{
+	u_int64_t task;
+	for (;;) {
+		if (popBottom(&pool->deques[index], &task)) {
+			pool->function(pool->arg, task, index);
+			continue;
+		}
+		int stolen = 0;
+		for (int offset = 1; offset < pool->threads && !stolen; offset++) {
+			stolen = stealTop(&pool->deques[(index + offset) % pool->threads], &task);
+		}
+		if (!stolen) {
+			return;
+		}
+		pool->function(pool->arg, task, index);
+	}
+}
+
+static void* workerMain(void* argument)
+{
+	WorkerStart* start = (WorkerStart*) argument;
+	ThreadPool* pool = start->pool;
+	u_int64_t seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->generation == seen && !pool->stopping) {
+			pthread_cond_wait(&pool->start, &pool->lock);
+		}
+		if (pool->stopping) {
+			break;
+		}
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		work(pool, start->index);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->busy -= 1;
+		if (pool->busy == 0) {
+			pthread_cond_signal(&pool->done);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+ThreadPool* newThreadPool(int threads)
+{
+	if (threads < 1) {
+		return NULL;
+	}
+	ThreadPool* pool = (ThreadPool*) calloc(1, sizeof(ThreadPool));
+	if (pool == NULL) {
+		return NULL;
+	}
+	pool->threads = threads;
+	pool->workers = (pthread_t*) malloc(threads * sizeof(pthread_t));
+	pool->starts = (WorkerStart*) malloc(threads * sizeof(WorkerStart));
+	pool->deques = (WorkDeque*) calloc(threads, sizeof(WorkDeque));
+	if (pool->workers == NULL || pool->starts == NULL || pool->deques == NULL) {
+		free(pool->workers);
+		free(pool->starts);
+		free(pool->deques);
+		free(pool);
+		return NULL;
+	}
+	pthread_mutex_init(&pool->runLock, NULL);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	for (int i = 0; i < threads; i++) {
+		pthread_mutex_init(&pool->deques[i].lock, NULL);
+	}
+	/* worker 0 is whoever calls ThreadPoolRun, so only threads-1 threads are started */
+	for (int i = 1; i < threads; i++) {
+		pool->starts[i].pool = pool;
+		pool->starts[i].index = i;
+		if (pthread_create(&pool->workers[i], NULL, workerMain, &pool->starts[i]) != 0) {
+			pool->threads = i;
+			freeThreadPool(pool);
+			return NULL;
+		}
+	}
+	return pool;
+}
+
+void ThreadPoolRun(ThreadPool* pool, u_int64_t taskCount, ThreadPoolTask function, void* arg)
+{
+	pthread_mutex_lock(&pool->runLock);
+	/* hand every worker an equal contiguous share up front; stealing evens out the rest */
+	for (int i = 0; i < pool->threads; i++) {
+		pthread_mutex_lock(&pool->deques[i].lock);
+		pool->deques[i].top = taskCount * i / pool->threads;
+		pool->deques[i].bottom = taskCount * (i + 1) / pool->threads;
+		pthread_mutex_unlock(&pool->deques[i].lock);
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->function = function;
+	pool->arg = arg;
+	pool->busy = pool->threads - 1;
+	pool->generation += 1;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	work(pool, 0);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busy > 0) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	pthread_mutex_unlock(&pool->runLock);
+}
+
+int ThreadPoolSize(ThreadPool* pool)
+{
+	return pool->threads;
+}
+
+void freeThreadPool(ThreadPool* pool)
+{
+	if (pool == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+	for (int i = 1; i < pool->threads; i++) {
+		pthread_join(pool->workers[i], NULL);
+	}
+	for (int i = 0; i < pool->threads; i++) {
+		pthread_mutex_destroy(&pool->deques[i].lock);
+	}
+	pthread_mutex_destroy(&pool->runLock);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->start);
+	pthread_cond_destroy(&pool->done);
+	free(pool->workers);
+	free(pool->starts);
+	free(pool->deques);
+	free(pool);
+}
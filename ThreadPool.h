@@ -0,0 +1,33 @@
+/*********************
+**  Thread pool
+**  A fixed set of worker threads that run parallel loops over task indices.
+**  Every worker owns a deque of tasks and steals from the others once its own deque runs dry,
+**  so loops whose tasks have very uneven cost still keep every core busy.
+**********************/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <sys/types.h>
+
+typedef struct ThreadPool ThreadPool;
+
+//A task body: runs task number task on the worker with the given index (0 <= worker < ThreadPoolSize)
+typedef void (*ThreadPoolTask)(void* arg, u_int64_t task, int worker);
+
+//Returns a new pool that runs loops on threads threads, counting the thread that calls ThreadPoolRun. Returns NULL on failure.
+ThreadPool* newThreadPool(int threads);
+
+/*
+Runs function(arg, task, worker) once for every task in 0..taskCount-1 and returns when all of them are done.
+The calling thread works as worker 0. Calls from several threads at once are run one after another.
+*/
+void ThreadPoolRun(ThreadPool* pool, u_int64_t taskCount, ThreadPoolTask function, void* arg);
+
+//Returns the number of workers, counting the calling thread
+int ThreadPoolSize(ThreadPool* pool);
+
+//Stops the worker threads and frees the pool
+void freeThreadPool(ThreadPool* pool);
+
+#endif
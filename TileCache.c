@@ -0,0 +1,258 @@
+/*********************
+**  Tile cache
+**  A hash table for lookups plus a list from most to least recently used for eviction, both under one lock.
+**  Renders run outside the lock. A tile being rendered is already in the table, marked as such, and later
+**  requests for it sleep on the cache's condition variable until the render is done.
+**  Tiles in use are never evicted, so the budget can be exceeded for as long as they are held.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "TileCache.h"
+#include "Hash.h"
+
+#define TILE_RENDERING 0
+#define TILE_READY 1
+#define TILE_FAILED 2
+
+//Hash chains; a few thousand tiles fit in a typical budget, so chains stay short
+#define TILE_CACHE_BUCKETS 4096
+
+struct Tile
+{
+	TileKey key;
+	u_int64_t hash;
+	uint8_t* data;
+	u_int64_t length;
+	int state;
+	int references;  //Acquired and not yet released
+	int cached;      //Still in the table and the list
+	Tile* next;      //Hash chain
+	Tile* newer;
+	Tile* older;
+};
+
+struct TileCache
+{
+	pthread_mutex_t lock;
+	pthread_cond_t rendered;
+	Tile* buckets[TILE_CACHE_BUCKETS];
+	Tile* newest;
+	Tile* oldest;
+	u_int64_t capacity;
+	u_int64_t bytes;
+	u_int64_t tiles;
+	u_int64_t hits;
+	u_int64_t misses;
+	u_int64_t coalesced;
+	u_int64_t evictions;
+};
+
+TileCache* newTileCache(u_int64_t capacity)
+{
+	TileCache* cache = (TileCache*) calloc(1, sizeof(TileCache));
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache->capacity = capacity;
+	pthread_mutex_init(&cache->lock, NULL);
+	pthread_cond_init(&cache->rendered, NULL);
+	return cache;
+}
+
+static void freeTile(Tile* tile)
+{
+	free(tile->data);
+	free(tile);
+}
+
+//The list functions below are all called with the lock held
+static void listRemove(TileCache* cache, Tile* tile)
+{
+	if (tile->newer != NULL) {
+		tile->newer->older = tile->older;
+	}
+	else {
+		cache->newest = tile->older;
+	}
+	if (tile->older != NULL) {
+		tile->older->newer = tile->newer;
+	}
+	else {
+		cache->oldest = tile->newer;
+	}
+	tile->newer = NULL;
+	tile->older = NULL;
+}
+
+static void listPushNewest(TileCache* cache, Tile* tile)
+{
+	tile->older = cache->newest;
+	tile->newer = NULL;
+	if (cache->newest != NULL) {
+		cache->newest->newer = tile;
+	}
+	cache->newest = tile;
+	if (cache->oldest == NULL) {
+		cache->oldest = tile;
+	}
+}
+
+//Takes tile out of the table and the list. Its bytes no longer count against the budget.
+static void uncache(TileCache* cache, Tile* tile)
+{
+	Tile** link = &cache->buckets[tile->hash % TILE_CACHE_BUCKETS];
+	while (*link != tile) {
+		link = &(*link)->next;
+	}
+	*link = tile->next;
+	listRemove(cache, tile);
+	tile->cached = 0;
+	cache->tiles -= 1;
+	if (tile->state == TILE_READY) {
+		cache->bytes -= tile->length + sizeof(Tile);
+	}
+}
+
+//Evicts unused tiles, least recently used first, until the cache is within its budget or nothing more can go
+static void evict(TileCache* cache)
+{
+	Tile* tile = cache->oldest;
+	while (cache->bytes > cache->capacity && tile != NULL) {
+		Tile* newer = tile->newer;
+		if (tile->references == 0 && tile->state == TILE_READY) {
+			uncache(cache, tile);
+			freeTile(tile);
+			cache->evictions += 1;
+		}
+		tile = newer;
+	}
+}
+
+Tile* TileCacheAcquire(TileCache* cache, const TileKey* key, TileRender render, void* arg, int* how)
+{
+	u_int64_t hash = HashBytes(HASH_SEED, key, sizeof(TileKey));
+	pthread_mutex_lock(&cache->lock);
+	Tile* tile = cache->buckets[hash % TILE_CACHE_BUCKETS];
+	while (tile != NULL && (tile->hash != hash || memcmp(&tile->key, key, sizeof(TileKey)) != 0)) {
+		tile = tile->next;
+	}
+	if (tile != NULL) {
+		tile->references += 1;
+		listRemove(cache, tile);
+		listPushNewest(cache, tile);
+		if (tile->state == TILE_RENDERING) {
+			*how = TILE_COALESCED;
+			cache->coalesced += 1;
+			while (tile->state == TILE_RENDERING) {
+				pthread_cond_wait(&cache->rendered, &cache->lock);
+			}
+		}
+		else {
+			*how = TILE_HIT;
+			cache->hits += 1;
+		}
+		int failed = tile->state == TILE_FAILED;
+		pthread_mutex_unlock(&cache->lock);
+		if (failed) {
+			TileCacheRelease(cache, tile);
+			return NULL;
+		}
+		return tile;
+	}
+
+	tile = (Tile*) calloc(1, sizeof(Tile));
+	if (tile == NULL) {
+		pthread_mutex_unlock(&cache->lock);
+		return NULL;
+	}
+	tile->key = *key;
+	tile->hash = hash;
+	tile->state = TILE_RENDERING;
+	tile->references = 1;
+	tile->cached = 1;
+	tile->next = cache->buckets[hash % TILE_CACHE_BUCKETS];
+	cache->buckets[hash % TILE_CACHE_BUCKETS] = tile;
+	listPushNewest(cache, tile);
+	cache->tiles += 1;
+	cache->misses += 1;
+	*how = TILE_MISS;
+	pthread_mutex_unlock(&cache->lock);
+
+	u_int64_t length = 0;
+	uint8_t* data = render(arg, key, &length);
+
+	pthread_mutex_lock(&cache->lock);
+	if (data == NULL) {
+		/* a failed render is not cached: the next request tries again */
+		uncache(cache, tile);
+		tile->state = TILE_FAILED;
+	}
+	else {
+		tile->data = data;
+		tile->length = length;
+		tile->state = TILE_READY;
+		cache->bytes += length + sizeof(Tile);
+	}
+	pthread_cond_broadcast(&cache->rendered);
+	pthread_mutex_unlock(&cache->lock);
+	if (data == NULL) {
+		TileCacheRelease(cache, tile);
+		return NULL;
+	}
+	return tile;
+}
+
+const uint8_t* TileData(const Tile* tile)
+{
+	return tile->data;
+}
+
+u_int64_t TileLength(const Tile* tile)
+{
+	return tile->length;
+}
+
+void TileCacheRelease(TileCache* cache, Tile* tile)
+{
+	pthread_mutex_lock(&cache->lock);
+	tile->references -= 1;
+	int orphaned = tile->references == 0 && !tile->cached;
+	if (!orphaned) {
+		evict(cache);
+	}
+	pthread_mutex_unlock(&cache->lock);
+	if (orphaned) {
+		freeTile(tile);
+	}
+}
+
+void TileCacheGetStats(TileCache* cache, TileCacheStats* stats)
+{
+	pthread_mutex_lock(&cache->lock);
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	stats->coalesced = cache->coalesced;
+	stats->evictions = cache->evictions;
+	stats->tiles = cache->tiles;
+	stats->bytes = cache->bytes;
+	stats->capacity = cache->capacity;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void freeTileCache(TileCache* cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+	while (cache->oldest != NULL) {
+		Tile* tile = cache->oldest;
+		uncache(cache, tile);
+		freeTile(tile);
+	}
+	pthread_cond_destroy(&cache->rendered);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
@@ -0,0 +1,77 @@
+/*********************
+**  Tile cache
+**  Rendered tiles kept in memory, least recently used first out, under a byte budget.
+**  Requests for a tile that is still being rendered wait for that render instead of starting their own,
+**  so any number of concurrent requests for one tile cost a single render.
+**********************/
+
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+Everything that decides the contents of a tile. Every field is 8 bytes wide, so keys have no padding
+and can be hashed and compared as plain bytes.
+*/
+typedef struct TileKey
+{
+	u_int64_t zoom;
+	u_int64_t x;
+	u_int64_t y;
+	double threshold;
+	u_int64_t max_iterations;
+	u_int64_t palette;
+} TileKey;
+
+typedef struct Tile Tile;
+
+typedef struct TileCache TileCache;
+
+//How TileCacheAcquire found its tile
+#define TILE_HIT 0       //Already rendered
+#define TILE_MISS 1      //Rendered by this call
+#define TILE_COALESCED 2 //Rendered by a concurrent call, which this one waited for
+
+/*
+Renders the tile of key. Returns its bytes in memory from malloc, which the cache takes over, and sets length,
+or returns NULL on failure.
+*/
+typedef uint8_t* (*TileRender)(void* arg, const TileKey* key, u_int64_t* length);
+
+//Returns a new cache holding at most capacity bytes of tiles, or NULL on failure
+TileCache* newTileCache(u_int64_t capacity);
+
+/*
+Returns the tile of key, calling render(arg, key, ...) on this thread if nobody has rendered it or is rendering it.
+The tile stays valid, even if it is evicted, until it is handed back with TileCacheRelease.
+Sets how to one of TILE_HIT, TILE_MISS and TILE_COALESCED. Returns NULL if the render failed.
+*/
+Tile* TileCacheAcquire(TileCache* cache, const TileKey* key, TileRender render, void* arg, int* how);
+
+//The bytes of tile, and their number
+const uint8_t* TileData(const Tile* tile);
+u_int64_t TileLength(const Tile* tile);
+
+//Hands back a tile returned by TileCacheAcquire
+void TileCacheRelease(TileCache* cache, Tile* tile);
+
+//Counters since the cache was made
+typedef struct TileCacheStats
+{
+	u_int64_t hits;
+	u_int64_t misses;
+	u_int64_t coalesced;
+	u_int64_t evictions;
+	u_int64_t tiles;     //Tiles held right now
+	u_int64_t bytes;     //Bytes they take up
+	u_int64_t capacity;
+} TileCacheStats;
+
+void TileCacheGetStats(TileCache* cache, TileCacheStats* stats);
+
+//Frees the cache and every tile in it. No tile may still be acquired.
+void freeTileCache(TileCache* cache);
+
+#endif
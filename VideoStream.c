@@ -0,0 +1,186 @@
+/*********************
+**  Video streams
+**  Frames are converted into a reusable plane buffer and written with one writev each,
+**  so a movie costs one open file instead of one file per frame.
+**********************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "VideoStream.h"
+#include "PPMWriter.h"
+
+struct VideoStream
+{
+	int fd;
+	int ownsFd;
+	int format;
+	u_int64_t width;
+	u_int64_t height;
+	uint8_t* planes;  //Y, U and V planes of the frame being written (Y4M only)
+	int failed;
+};
+
+int VideoStreamFormatNamed(const char* name)
+{
+	if (strcmp(name, "y4m") == 0) {
+		return VIDEO_STREAM_Y4M;
+	}
+	if (strcmp(name, "rgb") == 0) {
+		return VIDEO_STREAM_RGB;
+	}
+	return -1;
+}
+
+VideoStream* newVideoStream(const char* filename, int fd, int format, u_int64_t width, u_int64_t height, int fps)
+{
+	VideoStream* stream = (VideoStream*) calloc(1, sizeof(VideoStream));
+	if (stream == NULL) {
+		return NULL;
+	}
+	stream->format = format;
+	stream->width = width;
+	stream->height = height;
+	stream->fd = fd;
+	if (filename != NULL) {
+		stream->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		stream->ownsFd = 1;
+	}
+	if (format == VIDEO_STREAM_Y4M) {
+		stream->planes = (uint8_t*) malloc(3 * width * height);
+	}
+	if (stream->fd < 0 || (format == VIDEO_STREAM_Y4M && stream->planes == NULL)) {
+		freeVideoStream(stream);
+		return NULL;
+	}
+	if (format == VIDEO_STREAM_Y4M) {
+		char header[128];
+		int length = snprintf(header, sizeof(header), "YUV4MPEG2 W%lu H%lu F%d:1 Ip A1:1 C444\n", width, height, fps);
+		struct iovec iov = {header, (size_t) length};
+		stream->failed = PPMWriteAll(stream->fd, &iov, 1);
+	}
+	return stream;
+}
+
+int VideoStreamWriteFrame(VideoStream* stream, const uint8_t* rgb)
+{
+	u_int64_t pixels = stream->width * stream->height;
+	if (stream->failed) {
+		return 1;
+	}
+	if (stream->format == VIDEO_STREAM_RGB) {
+		struct iovec iov = {(void*) rgb, 3 * pixels};
+		stream->failed = PPMWriteAll(stream->fd, &iov, 1);
+		return stream->failed;
+	}
+	RGBToYUV444(rgb, pixels, stream->planes, stream->planes + pixels, stream->planes + 2 * pixels);
+	struct iovec iov[2] = {{"FRAME\n", 6}, {stream->planes, 3 * pixels}};
+	stream->failed = PPMWriteAll(stream->fd, iov, 2);
+	return stream->failed;
+}
+
+int freeVideoStream(VideoStream* stream)
+{
+	if (stream == NULL) {
+		return 0;
+	}
+	int failed = stream->failed;
+	if (stream->ownsFd && stream->fd >= 0 && close(stream->fd) != 0) {
+		failed = 1;
+	}
+	free(stream->planes);
+	free(stream);
+	return failed;
+}
+
+//One pixel of RGBToYUV444
+static inline void convertPixel(const uint8_t* rgb, uint8_t* y, uint8_t* u, uint8_t* v)
+{
+	int r = rgb[0];
+	int g = rgb[1];
+	int b = rgb[2];
+	*y = (uint8_t) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+	*u = (uint8_t) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+	*v = (uint8_t) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/*
+Sixteen pixels at a time. The 48 interleaved bytes are split into R, G and B vectors by byte shuffles,
+widened to 16-bit lanes, and run through the same integer formulas. Every intermediate fits in 16 bits:
+U and V stay within +-28688, and Y, which can reach 56228, is only ever shifted logically.
+Returns the number of pixels done.
+*/
+__attribute__((target("avx2")))
+static u_int64_t convertAVX2(const uint8_t* rgb, u_int64_t pixels, uint8_t* y, uint8_t* u, uint8_t* v)
+{
+	const __m128i redA = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i redB = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+	const __m128i redC = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+	const __m128i greenA = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i greenB = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+	const __m128i greenC = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+	const __m128i blueA = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i blueB = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+	const __m128i blueC = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+	const __m256i round = _mm256_set1_epi16(128);
+	u_int64_t i = 0;
+	for (; i + 16 <= pixels; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*) (rgb + 3 * i));
+		__m128i b = _mm_loadu_si128((const __m128i*) (rgb + 3 * i + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*) (rgb + 3 * i + 32));
+		__m256i r = _mm256_cvtepu8_epi16(_mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, redA), _mm_shuffle_epi8(b, redB)), _mm_shuffle_epi8(c, redC)));
+		__m256i g = _mm256_cvtepu8_epi16(_mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, greenA), _mm_shuffle_epi8(b, greenB)), _mm_shuffle_epi8(c, greenC)));
+		__m256i bl = _mm256_cvtepu8_epi16(_mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, blueA), _mm_shuffle_epi8(b, blueB)), _mm_shuffle_epi8(c, blueC)));
+
+		__m256i luma = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)), _mm256_mullo_epi16(g, _mm256_set1_epi16(129))),
+			_mm256_add_epi16(_mm256_mullo_epi16(bl, _mm256_set1_epi16(25)), round));
+		luma = _mm256_add_epi16(_mm256_srli_epi16(luma, 8), _mm256_set1_epi16(16));
+		__m256i blue = _mm256_add_epi16(_mm256_sub_epi16(_mm256_mullo_epi16(bl, _mm256_set1_epi16(112)), _mm256_mullo_epi16(r, _mm256_set1_epi16(38))),
+			_mm256_sub_epi16(round, _mm256_mullo_epi16(g, _mm256_set1_epi16(74))));
+		blue = _mm256_add_epi16(_mm256_srai_epi16(blue, 8), round);
+		__m256i red = _mm256_add_epi16(_mm256_sub_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(112)), _mm256_mullo_epi16(g, _mm256_set1_epi16(94))),
+			_mm256_sub_epi16(round, _mm256_mullo_epi16(bl, _mm256_set1_epi16(18))));
+		red = _mm256_add_epi16(_mm256_srai_epi16(red, 8), round);
+
+		/* packus works inside 128-bit halves, so the permute gathers the two useful quarters */
+		_mm_storeu_si128((__m128i*) (y + i), _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(luma, luma), 0x08)));
+		_mm_storeu_si128((__m128i*) (u + i), _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(blue, blue), 0x08)));
+		_mm_storeu_si128((__m128i*) (v + i), _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(red, red), 0x08)));
+	}
+	return i;
+}
+
+static int videoHasAVX2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+static u_int64_t convertAVX2(const uint8_t* rgb, u_int64_t pixels, uint8_t* y, uint8_t* u, uint8_t* v)
+{
+	return 0;
+}
+
+static int videoHasAVX2(void)
+{
+	return 0;
+}
+
+#endif
+
+void RGBToYUV444(const uint8_t* rgb, u_int64_t pixels, uint8_t* y, uint8_t* u, uint8_t* v)
+{
+	u_int64_t i = videoHasAVX2() ? convertAVX2(rgb, pixels, y, u, v) : 0;
+	for (; i < pixels; i++) {
+		convertPixel(rgb + 3 * i, y + i, u + i, v + i);
+	}
+}
@@ -0,0 +1,43 @@
+/*********************
+**  Video streams
+**  A whole movie written as one sequential stream instead of a folder of .ppm files, ready to be piped into an encoder:
+**  VIDEO_STREAM_Y4M: YUV4MPEG2 with full-resolution chroma (C444), converted from RGB with BT.601 studio-range coefficients
+**  VIDEO_STREAM_RGB: raw rgb24 frames back to back, with no header (ffmpeg -f rawvideo -pixel_format rgb24)
+**********************/
+
+#ifndef VIDEOSTREAM_H
+#define VIDEOSTREAM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define VIDEO_STREAM_Y4M 1
+#define VIDEO_STREAM_RGB 2
+
+typedef struct VideoStream VideoStream;
+
+//Returns the VIDEO_STREAM_* format called name ("y4m" or "rgb"), or -1 for an unknown name
+int VideoStreamFormatNamed(const char* name);
+
+/*
+Opens a stream of width x height frames at fps frames per second in the given format, writing to filename,
+or to file descriptor fd when filename is NULL. Returns NULL on failure.
+*/
+VideoStream* newVideoStream(const char* filename, int fd, int format, u_int64_t width, u_int64_t height, int fps);
+
+//Appends one frame of 3-byte RGB pixels, row by row. Frames must come in order. Returns 0 on success and 1 on failure.
+int VideoStreamWriteFrame(VideoStream* stream, const uint8_t* rgb);
+
+//Flushes and closes the stream. Returns 0 if everything was written and 1 otherwise.
+int freeVideoStream(VideoStream* stream);
+
+/*
+Converts pixels RGB pixels into the planes y, u and v:
+	Y = ((66 R + 129 G + 25 B + 128) >> 8) + 16
+	U = ((-38 R - 74 G + 112 B + 128) >> 8) + 128
+	V = ((112 R - 94 G - 18 B + 128) >> 8) + 128
+Uses AVX2 when the CPU has it; the result is the same either way.
+*/
+void RGBToYUV444(const uint8_t* rgb, u_int64_t pixels, uint8_t* y, uint8_t* u, uint8_t* v);
+
+#endif
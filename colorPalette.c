@@ -9,6 +9,7 @@
 #include <math.h>
 #include <string.h>
 #include "ColorMapInput.h"
+#include "PPMWriter.h"
 
 //You don't need to call this function but it helps you understand how the arguments are passed in 
 void usage(char* argv[])
@@ -16,8 +17,12 @@ void usage(char* argv[])
 	printf("Incorrect usage: Expected arguments are %s <inputfile> <outputfolder> <width> <heightpercolor>", argv[0]);
 }
 
-//Creates a color palette image for the given colorfile in outputfile. Width and heightpercolor dictates the dimensions of each color. Output should be in P3 format
-int P3colorpalette(char* colorfile, int width, int heightpercolor, char* outputfile)
+/*
+Writes the palette image of colorfile to outputfile in the given format (PPM_P3 or PPM_P6): every color fills
+heightpercolor rows of width pixels. Each color's row is built once and repeated by the PPM writer.
+With a writer, the image is only queued, and the write happens on the writer's thread.
+*/
+static int colorpalette(char* colorfile, int width, int heightpercolor, char* outputfile, int format, PPMWriter* writer)
 {
 	if (heightpercolor < 1) {
 		return 1;
@@ -25,83 +30,50 @@ int P3colorpalette(char* colorfile, int width, int heightpercolor, char* outputf
 	if (width < 1) {
 		return 1;
 	}
-	FILE* fileptr = fopen(outputfile, "w");
 	int* colorcount = malloc(sizeof(int));
-	uint8_t** returnPointer; 
+	if (colorcount == NULL) {
+		return 1;
+	}
+	uint8_t** returnPointer;
 	returnPointer = FileToColorMap(colorfile, colorcount);
-	int vertical = *colorcount * heightpercolor;
-	fprintf(fileptr, "%s ", "P3");
-	fprintf(fileptr, "%d ", width);
-	fprintf(fileptr, "%d ", vertical);
-	fprintf(fileptr, "%d\n", 255);
-
-	for (int x = 0; x < *colorcount; x++) {
-		for (int i = 0; i < heightpercolor; i++) {
-			for (int y = 0; y < width; y++) {
-				if ((y+1) == width) {
-					fprintf(fileptr, "%d ", returnPointer[x][0]);
-					fprintf(fileptr, "%d ", returnPointer[x][1]);
-					fprintf(fileptr, "%d\n", returnPointer[x][2]);
-				} else {
-					fprintf(fileptr, "%d ", returnPointer[x][0]);
-					fprintf(fileptr, "%d ", returnPointer[x][1]);
-					fprintf(fileptr, "%d ", returnPointer[x][2]);
-				}
-			}
+	if (returnPointer == NULL) {
+		free(colorcount);
+		return 1;
+	}
+	uint8_t* rows = (uint8_t*) malloc((size_t) *colorcount * width * 3);
+	PPMRun* runs = (PPMRun*) malloc(*colorcount * sizeof(PPMRun));
+	int failed = rows == NULL || runs == NULL;
+	for (int x = 0; x < *colorcount && !failed; x++) {
+		uint8_t* row = rows + (size_t) x * width * 3;
+		for (int y = 0; y < width; y++) {
+			memcpy(row + 3 * y, returnPointer[x], 3);
 		}
+		runs[x].pixels = row;
+		runs[x].repeat = heightpercolor;
 	}
-	int index = 0;
-	while (index < *colorcount) {
-		free(returnPointer[index]);
-		index += 1;
+	if (!failed && writer != NULL) {
+		failed = PPMWriterSubmitRuns(writer, outputfile, format, width, runs, *colorcount);
 	}
-	free(returnPointer);
+	else if (!failed) {
+		failed = WritePPMRuns(outputfile, format, width, runs, *colorcount);
+	}
+	free(rows);
+	free(runs);
+	freeDoublePointer(returnPointer, colorcount);
 	free(colorcount);
-	fclose(fileptr);
-	return 0;
+	return failed;
+}
+
+//Creates a color palette image for the given colorfile in outputfile. Width and heightpercolor dictates the dimensions of each color. Output should be in P3 format
+int P3colorpalette(char* colorfile, int width, int heightpercolor, char* outputfile)
+{
+	return colorpalette(colorfile, width, heightpercolor, outputfile, PPM_P3, NULL);
 }
 
 //Same as above, but with P6 format
 int P6colorpalette(char* colorfile, int width, int heightpercolor, char* outputfile)
 {
-	if (heightpercolor < 1) {
-		return 1;
-	}
-	if (width < 1) {
-		return 1;
-	}
-	FILE* fileptr = fopen(outputfile, "w");
-	if (fileptr == NULL) {
-		fclose(fileptr);
-		return 1;
-	}
-	int* colorcount = malloc(sizeof(int));
-	uint8_t** returnPointer;
-	returnPointer = FileToColorMap(colorfile, colorcount);
-	int vertical = *colorcount * heightpercolor;
-	fprintf(fileptr, "%s ", "P6");
-	fprintf(fileptr, "%d ", width);
-	fprintf(fileptr, "%d ", vertical);
-	fprintf(fileptr, "%d\n", 255);
-
-	for (int x = 0; x < *colorcount; x++) {
-		for (int i = 0; i < heightpercolor; i++) {
-			for (int y = 0; y < width; y++) {
-					fwrite(&returnPointer[x][0], sizeof(uint8_t), 1, fileptr);
-					fwrite(&returnPointer[x][1], sizeof(uint8_t), 1, fileptr);
-					fwrite(&returnPointer[x][2], sizeof(uint8_t), 1, fileptr);
-				}
-			}
-		}
-	int index = 0;
-	while (index < *colorcount) {
-		free(returnPointer[index]);
-		index += 1;
-	}
-	free(returnPointer);
-	fclose(fileptr);
-	free(colorcount);
-	return 0;
+	return colorpalette(colorfile, width, heightpercolor, outputfile, PPM_P6, NULL);
 }
 
 //The one piece of c code you don't have to read or understand. Still, might as well read it, if you have time.
@@ -118,14 +90,28 @@ int main(int argc, char* argv[])
 	char* P6end = "/colorpaletteP6.ppm";
 	char buffer[strlen(argv[2]) + strlen(P3end)+1];
 	sprintf(buffer, "%s%s", argv[2], P3end);
-	int failed = P3colorpalette(argv[1], width, height, buffer);
+	/* the P3 file is written on a background thread while the P6 one is written here */
+	PPMWriter* writer = newPPMWriter(1);
+	int failed;
+	if (writer != NULL) {
+		failed = colorpalette(argv[1], width, height, buffer, PPM_P3, writer);
+	}
+	else {
+		failed = P3colorpalette(argv[1], width, height, buffer);
+	}
 	if (failed)
 	{
+		freePPMWriter(writer);
 		printf("Error in making P3colorpalette");
 		return 1;
 	}
 	sprintf(buffer, "%s%s", argv[2], P6end);
 	failed = P6colorpalette(argv[1], width, height, buffer);
+	if (freePPMWriter(writer))
+	{
+		printf("Error in making P3colorpalette");
+		return 1;
+	}
 	if (failed)
 	{
 		printf("Error in making P6colorpalette");